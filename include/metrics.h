@@ -0,0 +1,188 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace MicroTransformer
+{
+
+    enum class Counter
+    {
+        Requests,          // Encoder forward passes started
+        Tokens,            // Input rows across those passes
+        CoalescedRequests, // Requests answered by another request's forward
+        RejectedRequests,  // Refused by queue admission control
+        ShedRequests,      // Dropped from the queue after admission
+        CacheHits,
+        CacheMisses,
+        CacheEvictions,
+        ModelLoads,
+        ModelEvictions,
+        Allocations,    // Matrix buffers allocated
+        AllocatedBytes, // Bytes in those buffers
+        Count
+    };
+
+    enum class Histogram
+    {
+        BatchSize,          // Requests per batching-queue batch
+        QueueWaitSeconds,   // Submit to batch start
+        ForwardSeconds,     // Whole encoder forward
+        AttentionSeconds,   // Per-layer operator latencies
+        FeedForwardSeconds, // FFN or MoE
+        LayerNormSeconds,
+        Count
+    };
+
+    // Process-wide runtime telemetry. Every thread updates its own shard with plain
+    // relaxed stores (no read-modify-write, no locks); a scrape sums all shards.
+    // A finished thread's counts are folded into a retired total and its shard reused.
+    namespace Metrics
+    {
+        using Clock = std::chrono::steady_clock;
+
+        void increment(Counter counter, uint64_t amount = 1);
+        void observe(Histogram histogram, double value);
+
+        inline void observe_since(Histogram histogram, Clock::time_point start)
+        {
+            observe(histogram, std::chrono::duration<double>(Clock::now() - start).count());
+        }
+
+        // Run `op` and record its wall time
+        template <typename Op>
+        auto timed(Histogram histogram, Op &&op)
+        {
+            Clock::time_point start = Clock::now();
+            auto result = op();
+            observe_since(histogram, start);
+            return result;
+        }
+
+        // Records the time until the end of the enclosing scope
+        class ScopedTimer
+        {
+        public:
+            explicit ScopedTimer(Histogram histogram) : histogram_(histogram), start_(Clock::now()) {}
+            ~ScopedTimer() { observe_since(histogram_, start_); }
+
+            ScopedTimer(const ScopedTimer &) = delete;
+            ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+        private:
+            Histogram histogram_;
+            Clock::time_point start_;
+        };
+
+        uint64_t counter_value(Counter counter);
+
+        // Prometheus text exposition format (version 0.0.4) of every counter and histogram
+        std::string render_prometheus();
+    } // namespace Metrics
+
+    // Per-operator breakdown of one forward that exceeded the slow-request threshold
+    struct FlightRecord
+    {
+        static constexpr size_t MAX_OPS = 64;
+
+        struct Op
+        {
+            Histogram kind; // AttentionSeconds, FeedForwardSeconds or LayerNormSeconds
+            uint32_t layer;
+            float seconds;
+        };
+
+        uint64_t id;           // Capture order
+        int64_t unix_time_ms;  // When the forward finished
+        double total_seconds;
+        uint32_t threads;      // OpenMP threads available to the forward (1 when serial)
+        uint32_t rows, cols;   // Input sequence length and width
+        uint32_t batch_size;   // Requests in the batch being served (1 outside a batching queue)
+        uint32_t batch_inputs; // Distinct inputs in that batch
+        uint32_t waiters;      // Requests answered by this forward
+        uint32_t num_ops;
+        uint32_t dropped_ops;  // Ops past MAX_OPS
+        Op ops[MAX_OPS];
+    };
+
+    // Always-on capture of slow forwards. Each forward collects its op timings on the
+    // stack; only forwards slower than the threshold are copied into a fixed ring of
+    // recent records (seqlock slots, no locks), which can be dumped at any time.
+    namespace FlightRecorder
+    {
+        void set_threshold(double seconds); // 0 disables capture (the default)
+        double threshold();
+
+        std::vector<FlightRecord> snapshot(); // Oldest first
+        void dump(std::ostream &out);
+
+        // Dump to `path` (appending; stderr when empty) whenever `signal_number` arrives.
+        // The handler only writes to a pipe; a background thread does the dump. POSIX only.
+        void dump_on_signal(int signal_number, const std::string &path = "");
+
+        // Scope of one encoder forward on the current thread
+        class Trace
+        {
+        public:
+            Trace(size_t rows, size_t cols, size_t threads);
+            ~Trace();
+
+            Trace(const Trace &) = delete;
+            Trace &operator=(const Trace &) = delete;
+
+            void set_layer(size_t layer) { layer_ = static_cast<uint32_t>(layer); }
+            void add_op(Histogram kind, double seconds);
+
+        private:
+            bool active_;
+            uint32_t layer_ = 0;
+            Trace *previous_;
+            Metrics::Clock::time_point start_;
+            FlightRecord record_;
+        };
+
+        // Batch composition attached to forwards run on this thread within the scope
+        class BatchScope
+        {
+        public:
+            BatchScope(size_t batch_size, size_t batch_inputs, size_t waiters);
+            ~BatchScope();
+
+            BatchScope(const BatchScope &) = delete;
+            BatchScope &operator=(const BatchScope &) = delete;
+
+        private:
+            uint32_t previous_[3];
+        };
+    } // namespace FlightRecorder
+
+    // Serves render_prometheus() to any request on a loopback TCP port or a Unix
+    // socket, from one background thread. POSIX only; throws on Windows builds.
+    class MetricsServer
+    {
+    public:
+        explicit MetricsServer(uint16_t port); // 127.0.0.1; 0 picks a free port
+        explicit MetricsServer(const std::string &unix_socket_path);
+        ~MetricsServer();
+
+        MetricsServer(const MetricsServer &) = delete;
+        MetricsServer &operator=(const MetricsServer &) = delete;
+
+        uint16_t port() const { return port_; }
+
+    private:
+        int listen_fd_ = -1;
+        uint16_t port_ = 0;
+        std::string unix_socket_path_;
+        std::atomic<bool> stopping_{false};
+        std::thread thread_;
+
+        void serve();
+    };
+
+} // namespace MicroTransformer
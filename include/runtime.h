@@ -0,0 +1,319 @@
+#pragma once
+
+#include "transformer.h"
+#include "metrics.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <semaphore>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace MicroTransformer
+{
+
+    // 128-bit content hash (MurmurHash3 x64-128)
+    struct Hash128
+    {
+        uint64_t low = 0;
+        uint64_t high = 0;
+
+        bool operator==(const Hash128 &other) const { return low == other.low && high == other.high; }
+    };
+
+    Hash128 hash_bytes(const void *data, size_t size, uint64_t seed = 0);
+
+    // Hash of a matrix's shape and contents, seeded with a model id
+    Hash128 hash_matrix(const Matrix &matrix, uint64_t model_id);
+
+    struct Hash128Hasher
+    {
+        size_t operator()(const Hash128 &hash) const { return static_cast<size_t>(hash.low); }
+    };
+
+    // Same shape and bitwise-identical contents
+    bool same_matrix(const Matrix &a, const Matrix &b);
+
+    struct CacheStats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t entries;
+        size_t bytes;
+    };
+
+    // In-process LRU cache of encoder outputs keyed by a hash of (model id, output
+    // kind, input contents). Sharded so concurrent requests rarely share a lock.
+    class ResponseCache
+    {
+    public:
+        explicit ResponseCache(size_t memory_budget_bytes, size_t num_shards = 16);
+
+        std::optional<Matrix> lookup(uint64_t model_id, const Matrix &input, Pooling pooling = Pooling::None);
+        void insert(uint64_t model_id, const Matrix &input, const Matrix &output, Pooling pooling = Pooling::None);
+
+        // Cached output, or run the encoder and remember the result
+        Matrix forward(TransformerEncoder &encoder, uint64_t model_id, const Matrix &input,
+                       bool use_parallel = true);
+        Matrix forward(TransformerEncoder &encoder, uint64_t model_id, const Matrix &input,
+                       Pooling pooling, bool use_parallel = true);
+
+        CacheStats stats() const;
+        void clear();
+
+    private:
+        struct Entry
+        {
+            Hash128 key;
+            Matrix output;
+        };
+
+        struct Shard
+        {
+            std::mutex mutex;
+            std::list<Entry> lru; // Most recently used first
+            std::unordered_map<Hash128, std::list<Entry>::iterator, Hash128Hasher> index;
+            size_t bytes = 0;
+        };
+
+        size_t shard_budget_;
+        std::vector<std::unique_ptr<Shard>> shards_;
+        std::atomic<uint64_t> hits_{0}, misses_{0}, evictions_{0};
+
+        static Hash128 make_key(uint64_t model_id, const Matrix &input, Pooling pooling);
+        Shard &shard_for(const Hash128 &key) { return *shards_[key.high % shards_.size()]; }
+        static size_t entry_bytes(const Matrix &output);
+    };
+
+    struct BatchingOptions
+    {
+        std::chrono::microseconds batching_window{2000}; // How long the first request waits for company
+        size_t max_batch_size = 32;                      // Requests taken per batch
+        bool use_parallel = true;
+
+        // Admission control: input rows allowed in the queue at once (0 = unbounded).
+        // When full, a request displaces queued requests of lower priority or is rejected
+        size_t token_budget = 0;
+    };
+
+    // Service order; higher classes are always batched first
+    enum class Priority
+    {
+        High,
+        Normal,
+        Low
+    };
+
+    struct RequestOptions
+    {
+        Priority priority = Priority::Normal;
+        // Rejected at submit, or shed while queued, once the estimated completion is later
+        Metrics::Clock::time_point deadline = Metrics::Clock::time_point::max();
+    };
+
+    // Error delivered through the future of a rejected or shed request
+    class AdmissionError : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    struct BatchingStats
+    {
+        uint64_t requests;  // Submitted
+        uint64_t forwards;  // Encoder passes actually run
+        uint64_t coalesced; // Requests answered by another request's forward
+        uint64_t batches;
+        uint64_t rejected;  // Refused at submit (budget or deadline)
+        uint64_t shed;      // Dropped after queueing (displaced or deadline missed)
+    };
+
+    // Request queue in front of an encoder. A worker thread collects requests for one
+    // batching window, coalesces identical inputs (hash, then exact compare) and runs
+    // each distinct input once, fulfilling every waiter of that input with the result.
+    // Admission is bounded by a token budget and by deadlines checked against a running
+    // estimate of seconds per input row, so overload sheds low-priority work instead
+    // of growing the queue.
+    class BatchingQueue
+    {
+    public:
+        explicit BatchingQueue(TransformerEncoder &encoder, const BatchingOptions &options = {});
+        ~BatchingQueue(); // Serves everything already queued, then joins the worker
+
+        BatchingQueue(const BatchingQueue &) = delete;
+        BatchingQueue &operator=(const BatchingQueue &) = delete;
+
+        std::future<Matrix> submit(Matrix input, const RequestOptions &request_options = {});
+
+        BatchingStats stats() const;
+
+    private:
+        static constexpr size_t NUM_PRIORITIES = 3;
+
+        struct Request
+        {
+            Matrix input;
+            Hash128 key;
+            std::promise<Matrix> result;
+            Metrics::Clock::time_point submitted;
+            Metrics::Clock::time_point deadline;
+        };
+
+        TransformerEncoder &encoder_;
+        BatchingOptions options_;
+
+        std::mutex mutex_;
+        std::condition_variable arrived_;
+        std::array<std::deque<Request>, NUM_PRIORITIES> pending_; // FIFO per priority class
+        size_t queued_requests_ = 0;
+        std::array<size_t, NUM_PRIORITIES> queued_tokens_{}; // Input rows per class
+        bool stopping_ = false;
+        std::thread worker_;
+
+        // Exponential moving average of forward time per input row, 0 until measured
+        std::atomic<double> seconds_per_token_{0.0};
+
+        std::atomic<uint64_t> requests_{0}, forwards_{0}, coalesced_{0}, batches_{0}, rejected_{0}, shed_{0};
+
+        void worker_loop();
+        void run_batch(std::vector<Request> &batch);
+        void shed(std::vector<Request> &dropped, const char *reason);
+    };
+
+    // Builds a model by name (reads its config and weights); called without registry locks held
+    using ModelLoader = std::function<std::unique_ptr<TransformerEncoder>(const std::string &name)>;
+
+    struct RegistryStats
+    {
+        uint64_t hits;      // Requests served by a resident model
+        uint64_t loads;     // Loader calls
+        uint64_t evictions; // Models dropped to stay within the budget
+        size_t resident_models;
+        size_t resident_bytes;
+    };
+
+    // Hosts many encoder variants in one process. Models are loaded on first use and
+    // kept in an LRU set bounded by their weight_bytes(); cold models are released to
+    // make room. Requests still holding an evicted model finish on it, and its memory
+    // goes when the last of them drops its reference. At most `concurrent_forwards`
+    // forwards run at once, each on a team of max_threads / concurrent_forwards threads
+    // (OpenMP gives every calling thread its own team), so a slow model only holds one
+    // slot and the teams together never oversubscribe the cores. Every loaded model
+    // sizes its operators from the process-wide calibrated ThreadCostModel.
+    class ModelRegistry
+    {
+    public:
+        // concurrent_forwards 0 picks one slot per 4 threads
+        ModelRegistry(ModelLoader loader, size_t memory_budget_bytes, size_t concurrent_forwards = 0);
+
+        // Resident model, loading it (and evicting cold ones) if needed. Concurrent
+        // acquires of a model that is loading wait for the one load in progress
+        std::shared_ptr<TransformerEncoder> acquire(const std::string &name);
+
+        Matrix forward(const std::string &name, const Matrix &input, bool use_parallel = true);
+
+        bool resident(const std::string &name) const;
+        void evict(const std::string &name);
+
+        RegistryStats stats() const;
+
+    private:
+        struct Resident
+        {
+            std::string name;
+            std::shared_ptr<TransformerEncoder> encoder;
+            size_t bytes;
+        };
+
+        ModelLoader loader_;
+        size_t memory_budget_;
+
+        mutable std::mutex mutex_;
+        std::list<Resident> lru_; // Most recently used first
+        std::unordered_map<std::string, std::list<Resident>::iterator> index_;
+        std::unordered_map<std::string, std::shared_future<std::shared_ptr<TransformerEncoder>>> loading_;
+        size_t resident_bytes_ = 0;
+
+        // Bounds concurrent forwards; each runs with team_threads_ OpenMP threads
+        size_t forward_slots_;
+        int team_threads_;
+        std::counting_semaphore<> compute_slots_;
+        std::shared_ptr<const ThreadCostModel> thread_model_;
+
+        std::atomic<uint64_t> hits_{0}, loads_{0}, evictions_{0};
+
+        void make_room(size_t bytes); // Requires mutex_
+    };
+
+    // Serves one model whose weights can be replaced while requests are running.
+    // Readers announce the global epoch in a slot before loading the live version; a
+    // replaced version is freed once no slot shows an epoch older than its retirement,
+    // so every in-flight forward finishes on the version it started with. Every
+    // published version gets the process-wide calibrated ThreadCostModel.
+    class HotSwapModel
+    {
+    public:
+        explicit HotSwapModel(std::unique_ptr<TransformerEncoder> initial);
+        ~HotSwapModel(); // No forward or reload may still be running
+
+        HotSwapModel(const HotSwapModel &) = delete;
+        HotSwapModel &operator=(const HotSwapModel &) = delete;
+
+        Matrix forward(const Matrix &input, bool use_parallel = true);
+
+        // Make `next` the live version; the previous one is retired
+        void publish(std::unique_ptr<TransformerEncoder> next);
+
+        // Load a checkpoint on a background thread, run `prepare` on it (pruning,
+        // compression, warm-up), then publish. If anything throws, the live version
+        // stays and the future carries the error.
+        std::future<void> reload_async(const std::string &path,
+                                       std::function<void(TransformerEncoder &)> prepare = nullptr);
+
+        uint64_t version() const { return epoch_.load() - 1; } // Publishes so far
+        size_t retired_versions() const { return retired_count_.load(); }
+
+        // Free retired versions that no reader can still be using
+        void reclaim();
+
+    private:
+        static constexpr size_t READER_SLOTS = 64;
+        static constexpr uint64_t IDLE = UINT64_MAX;
+
+        struct alignas(64) ReaderSlot
+        {
+            std::atomic<uint64_t> epoch{IDLE}; // Epoch seen on entry, IDLE when free
+        };
+
+        struct Retired
+        {
+            std::unique_ptr<TransformerEncoder> encoder;
+            uint64_t epoch; // Readers that entered at this epoch or later never saw it
+        };
+
+        std::atomic<TransformerEncoder *> current_; // Owned
+        std::atomic<uint64_t> epoch_{1};
+        std::array<ReaderSlot, READER_SLOTS> readers_;
+
+        std::shared_ptr<const ThreadCostModel> thread_model_;
+
+        std::mutex retire_mutex_;
+        std::vector<Retired> retired_;
+        std::atomic<size_t> retired_count_{0};
+
+        size_t enter();
+        void leave(size_t slot) { readers_[slot].epoch.store(IDLE); }
+    };
+
+} // namespace MicroTransformer
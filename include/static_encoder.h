@@ -0,0 +1,258 @@
+#pragma once
+
+#include "transformer.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace MicroTransformer
+{
+
+    // Fixed-shape encoder for latency-critical deployments. Every dimension is a template
+    // parameter, so all loop bounds are compile-time constants, and weights and scratch
+    // live in inline arrays: after construction forward() never allocates. The object is
+    // large; give it static storage or construct it once at startup.
+    //
+    // Loads the same ModelWeights checkpoints as TransformerEncoder, for the plain
+    // configuration only: softmax attention, dense FFN, no rotary or position bias,
+    // no token reduction. Runs single-threaded; use one instance per thread.
+    template <size_t SeqLen, size_t EmbedDim, size_t Heads, size_t FFDim, size_t Layers>
+    class StaticTransformerEncoder
+    {
+        static_assert(SeqLen > 0 && EmbedDim > 0 && FFDim > 0 && Layers > 0, "Dimensions must be positive");
+        static_assert(Heads > 0 && EmbedDim % Heads == 0, "Embedding dimension must be divisible by number of heads");
+
+    public:
+        static constexpr size_t HeadDim = EmbedDim / Heads;
+
+        // Row-major SeqLen x EmbedDim
+        using Sequence = std::array<float, SeqLen * EmbedDim>;
+
+        explicit StaticTransformerEncoder(const ModelWeights &weights)
+            : epsilon_(weights.config.epsilon)
+        {
+            const TransformerConfig &config = weights.config;
+            if (config.seq_length != SeqLen || config.embed_dim != EmbedDim || config.num_heads != Heads ||
+                config.ff_dim != FFDim || config.num_layers != Layers || weights.layers.size() != Layers)
+            {
+                throw std::invalid_argument("Checkpoint shape does not match the static encoder");
+            }
+            if (config.attention_type != AttentionType::Softmax || config.num_experts != 0 ||
+                config.token_reduction != TokenReduction::None || config.rotary_embeddings ||
+                config.position_bias != PositionBias::None || config.vocab_size != 0)
+            {
+                throw std::invalid_argument("Static encoder only supports the plain encoder configuration");
+            }
+
+            for (size_t l = 0; l < Layers; ++l)
+            {
+                const LayerWeights &source = weights.layers[l];
+                LayerParameters &target = layers_[l];
+                copy_weight(source.W_q, EmbedDim, EmbedDim, target.W_q, "W_q");
+                copy_weight(source.W_k, EmbedDim, EmbedDim, target.W_k, "W_k");
+                copy_weight(source.W_v, EmbedDim, EmbedDim, target.W_v, "W_v");
+                copy_weight(source.W_o, EmbedDim, EmbedDim, target.W_o, "W_o");
+                copy_weight(source.W1, EmbedDim, FFDim, target.W1, "W1");
+                copy_weight(source.b1, 1, FFDim, target.b1, "b1");
+                copy_weight(source.W2, FFDim, EmbedDim, target.W2, "W2");
+                copy_weight(source.b2, 1, EmbedDim, target.b2, "b2");
+                copy_weight(source.norm1_gamma, 1, EmbedDim, target.norm1_gamma, "norm1_gamma");
+                copy_weight(source.norm1_beta, 1, EmbedDim, target.norm1_beta, "norm1_beta");
+                copy_weight(source.norm2_gamma, 1, EmbedDim, target.norm2_gamma, "norm2_gamma");
+                copy_weight(source.norm2_beta, 1, EmbedDim, target.norm2_beta, "norm2_beta");
+            }
+        }
+
+        StaticTransformerEncoder(const StaticTransformerEncoder &) = delete;
+        StaticTransformerEncoder &operator=(const StaticTransformerEncoder &) = delete;
+
+        // `output` may alias `input`
+        void forward(const Sequence &input, Sequence &output)
+        {
+            x_ = input;
+            for (const LayerParameters &layer : layers_)
+            {
+                // Multi-Head Self-Attention with residual connection
+                attend(layer);
+                add_into(x_, attended_);
+                layer_norm(x_, layer.norm1_gamma, layer.norm1_beta);
+
+                // Feed-Forward Network with residual connection
+                multiply<SeqLen, EmbedDim, FFDim>(x_, layer.W1, hidden_);
+                for (size_t i = 0; i < SeqLen; ++i)
+                {
+                    float *row = &hidden_[i * FFDim];
+#pragma omp simd
+                    for (size_t j = 0; j < FFDim; ++j)
+                    {
+                        row[j] = std::max(0.0f, row[j] + layer.b1[j]);
+                    }
+                }
+                multiply<SeqLen, FFDim, EmbedDim>(hidden_, layer.W2, attended_);
+                for (size_t i = 0; i < SeqLen; ++i)
+                {
+#pragma omp simd
+                    for (size_t j = 0; j < EmbedDim; ++j)
+                    {
+                        x_[i * EmbedDim + j] += attended_[i * EmbedDim + j] + layer.b2[j];
+                    }
+                }
+                layer_norm(x_, layer.norm2_gamma, layer.norm2_beta);
+            }
+            output = x_;
+        }
+
+    private:
+        struct LayerParameters
+        {
+            std::array<float, EmbedDim * EmbedDim> W_q, W_k, W_v, W_o;
+            std::array<float, EmbedDim * FFDim> W1;
+            std::array<float, FFDim> b1;
+            std::array<float, FFDim * EmbedDim> W2;
+            std::array<float, EmbedDim> b2;
+            std::array<float, EmbedDim> norm1_gamma, norm1_beta, norm2_gamma, norm2_beta;
+        };
+
+        std::array<LayerParameters, Layers> layers_;
+        float epsilon_;
+
+        // Scratch reused by every forward
+        Sequence x_, q_, k_, v_, heads_, attended_;
+        std::array<float, SeqLen * FFDim> hidden_;
+        std::array<float, SeqLen> scores_;
+
+        template <size_t N>
+        static void copy_weight(const Matrix &source, size_t rows, size_t cols, std::array<float, N> &target,
+                                const char *name)
+        {
+            if (source.rows() != rows || source.cols() != cols)
+            {
+                throw std::invalid_argument(std::string("Checkpoint weight has the wrong shape: ") + name);
+            }
+            std::copy_n(source.data(), N, target.begin());
+        }
+
+        // out = a * b for row-major a (Rows x Inner) and b (Inner x Cols)
+        template <size_t Rows, size_t Inner, size_t Cols, size_t NA, size_t NB, size_t NO>
+        static void multiply(const std::array<float, NA> &a, const std::array<float, NB> &b, std::array<float, NO> &out)
+        {
+            static_assert(NA == Rows * Inner && NB == Inner * Cols && NO == Rows * Cols, "Shape mismatch");
+            out.fill(0.0f);
+            for (size_t i = 0; i < Rows; ++i)
+            {
+                float *out_row = &out[i * Cols];
+                for (size_t k = 0; k < Inner; ++k)
+                {
+                    const float a_ik = a[i * Inner + k];
+                    const float *b_row = &b[k * Cols];
+#pragma omp simd
+                    for (size_t j = 0; j < Cols; ++j)
+                    {
+                        out_row[j] += a_ik * b_row[j];
+                    }
+                }
+            }
+        }
+
+        static void add_into(Sequence &target, const Sequence &other)
+        {
+#pragma omp simd
+            for (size_t i = 0; i < SeqLen * EmbedDim; ++i)
+            {
+                target[i] += other[i];
+            }
+        }
+
+        // Reads x_, writes attended_ (the W_o projection of the concatenated heads)
+        void attend(const LayerParameters &layer)
+        {
+            multiply<SeqLen, EmbedDim, EmbedDim>(x_, layer.W_q, q_);
+            multiply<SeqLen, EmbedDim, EmbedDim>(x_, layer.W_k, k_);
+            multiply<SeqLen, EmbedDim, EmbedDim>(x_, layer.W_v, v_);
+
+            // Heads are column slices of Q/K/V, so no split or concat copies are needed
+            const float scale = 1.0f / std::sqrt(static_cast<float>(HeadDim));
+            heads_.fill(0.0f);
+            for (size_t h = 0; h < Heads; ++h)
+            {
+                const size_t offset = h * HeadDim;
+                for (size_t i = 0; i < SeqLen; ++i)
+                {
+                    const float *q_row = &q_[i * EmbedDim + offset];
+                    float max_score = -std::numeric_limits<float>::infinity();
+                    for (size_t j = 0; j < SeqLen; ++j)
+                    {
+                        const float *k_row = &k_[j * EmbedDim + offset];
+                        float sum = 0.0f;
+#pragma omp simd reduction(+ : sum)
+                        for (size_t d = 0; d < HeadDim; ++d)
+                        {
+                            sum += q_row[d] * k_row[d];
+                        }
+                        scores_[j] = sum * scale;
+                        max_score = std::max(max_score, scores_[j]);
+                    }
+
+                    float normalizer = 0.0f;
+                    for (size_t j = 0; j < SeqLen; ++j)
+                    {
+                        scores_[j] = std::exp(scores_[j] - max_score);
+                        normalizer += scores_[j];
+                    }
+
+                    float *out_row = &heads_[i * EmbedDim + offset];
+                    for (size_t j = 0; j < SeqLen; ++j)
+                    {
+                        const float weight = scores_[j] / normalizer;
+                        const float *v_row = &v_[j * EmbedDim + offset];
+#pragma omp simd
+                        for (size_t d = 0; d < HeadDim; ++d)
+                        {
+                            out_row[d] += weight * v_row[d];
+                        }
+                    }
+                }
+            }
+
+            multiply<SeqLen, EmbedDim, EmbedDim>(heads_, layer.W_o, attended_);
+        }
+
+        void layer_norm(Sequence &rows, const std::array<float, EmbedDim> &gamma,
+                        const std::array<float, EmbedDim> &beta) const
+        {
+            for (size_t i = 0; i < SeqLen; ++i)
+            {
+                float *row = &rows[i * EmbedDim];
+
+                float mean = 0.0f;
+#pragma omp simd reduction(+ : mean)
+                for (size_t j = 0; j < EmbedDim; ++j)
+                {
+                    mean += row[j];
+                }
+                mean /= static_cast<float>(EmbedDim);
+
+                float variance = 0.0f;
+#pragma omp simd reduction(+ : variance)
+                for (size_t j = 0; j < EmbedDim; ++j)
+                {
+                    float diff = row[j] - mean;
+                    variance += diff * diff;
+                }
+                variance /= static_cast<float>(EmbedDim);
+
+                float std_dev = std::sqrt(variance + epsilon_);
+#pragma omp simd
+                for (size_t j = 0; j < EmbedDim; ++j)
+                {
+                    row[j] = gamma[j] * ((row[j] - mean) / std_dev) + beta[j];
+                }
+            }
+        }
+    };
+
+} // namespace MicroTransformer
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <chrono>
@@ -8,6 +9,8 @@
 namespace MicroTransformer
 {
 
+    class BlockSparseMatrix;
+
     // Matrix class for efficient 2D array operations
     class Matrix
     {
@@ -27,12 +30,15 @@ namespace MicroTransformer
         size_t cols() const { return cols_; }
         float *data() { return data_.data(); }
         const float *data() const { return data_.data(); }
+        size_t bytes() const { return data_.size() * sizeof(float); }
 
         // Matrix operations
         Matrix operator*(const Matrix &other) const;
         Matrix multiply_blocked(const Matrix &other) const; // Blocked matrix multiplication for optimization
+        Matrix multiply_sparse(const BlockSparseMatrix &other) const; // Dense activations x block-CSR weights
         Matrix operator+(const Matrix &other) const;
         Matrix transpose() const;
+        Matrix row_range(size_t begin, size_t end) const; // Copy of rows [begin, end)
         void randomize(float min = -1.0f, float max = 1.0f);
         void zero();
 
@@ -41,6 +47,62 @@ namespace MicroTransformer
         std::vector<float> data_;
     };
 
+    // Attention engine used by MultiHeadAttention
+    enum class AttentionType
+    {
+        Softmax,  // Exact scaled dot-product attention, O(n^2) in sequence length
+        Linear,   // Kernelized linear attention phi(Q) (phi(K)^T V), O(n)
+        Linformer // Softmax attention over K/V projected to linformer_rank rows
+    };
+
+    // Feature map phi used by linear attention
+    enum class FeatureMap
+    {
+        EluPlusOne,    // elu(x) + 1
+        RandomFeatures // Performer positive random features approximating softmax
+    };
+
+    // Token reduction applied between encoder layers
+    enum class TokenReduction
+    {
+        None,
+        Prune, // Drop the tokens that received the least attention
+        Merge  // Average the most similar token pairs (ToMe bipartite matching)
+    };
+
+    // Pooling applied to the final encoder output
+    enum class Pooling
+    {
+        None, // Full seq x embed output
+        CLS,  // Row 0 only
+        Mean, // Mean over rows
+        Max   // Element-wise max over rows
+    };
+
+    // Storage format of the token embedding table
+    enum class EmbeddingStorage
+    {
+        Float32,
+        Float16,
+        Int8 // Symmetric per-row scale
+    };
+
+    // Positional encoding added by the token input stage
+    enum class PositionalEncoding
+    {
+        None,
+        Sinusoidal,
+        Learned
+    };
+
+    // Additive position bias on attention scores
+    enum class PositionBias
+    {
+        None,
+        ALiBi,     // -slope_h * |i - j| with geometric per-head slopes
+        T5Relative // Learned per-head bias over log-bucketed relative distance
+    };
+
     // Configuration for Transformer model
     struct TransformerConfig
     {
@@ -51,29 +113,272 @@ namespace MicroTransformer
         size_t num_layers = 6;     // Number of encoder layers
         float dropout_rate = 0.1f; // Dropout rate (not implemented)
         float epsilon = 1e-6f;     // Layer norm epsilon
+
+        // Block-sparse weights (used after prune_weights)
+        size_t sparse_block_rows = 1;          // Rows per stored weight block
+        size_t sparse_block_cols = 8;          // Columns per stored weight block
+        float sparse_density_threshold = 0.3f; // Use the sparse kernel below this block density
+
+        // Skip inactive W2 rows in the FFN once this fraction of ReLU outputs is zero
+        float activation_sparsity_threshold = 0.5f;
+
+        // Attention engine
+        AttentionType attention_type = AttentionType::Softmax;
+        FeatureMap feature_map = FeatureMap::EluPlusOne; // Linear attention only
+        size_t num_random_features = 64;                 // Per head, FeatureMap::RandomFeatures only
+        size_t linformer_rank = 64;                      // Projected K/V length, AttentionType::Linformer only
+
+        // Mixture-of-experts feed-forward (0 experts = dense FeedForwardNetwork)
+        size_t num_experts = 0;        // Experts per layer, each an ff_dim FeedForwardNetwork
+        size_t experts_per_token = 2;  // Top-k experts each row is routed to
+
+        // Token reduction between layers (every layer except the last)
+        TokenReduction token_reduction = TokenReduction::None;
+        size_t tokens_reduced_per_layer = 8; // Rows removed after each layer
+        bool keep_first_token = true;        // Never prune or merge row 0 (CLS)
+
+        // Token input stage (0 vocabulary = inputs are pre-embedded matrices)
+        size_t vocab_size = 0;
+        EmbeddingStorage embedding_storage = EmbeddingStorage::Float32;
+        PositionalEncoding positional_encoding = PositionalEncoding::Sinusoidal;
+
+        // Rotary position embeddings applied to Q and K inside attention
+        bool rotary_embeddings = false;
+        float rope_theta = 10000.0f;
+
+        // Additive position bias computed inside the score loop (softmax/Linformer-free attention only)
+        PositionBias position_bias = PositionBias::None;
+        size_t relative_buckets = 32;       // T5Relative only
+        size_t relative_max_distance = 128; // T5Relative only
+    };
+
+    // Cost model for sizing the OpenMP team of each operator: an op of `flops` takes
+    // flops * seconds_per_flop / t on t threads, plus fork/join overhead that grows with t.
+    // Calibrate with PerformanceBenchmark::calibrate_thread_model.
+    struct ThreadCostModel
+    {
+        double seconds_per_flop = 1e-9;   // Single-thread GEMM throughput
+        double fork_join_seconds = 0.0;   // Fixed cost of opening a parallel region
+        double per_thread_seconds = 0.0;  // Extra region cost per team member
+        size_t max_threads = 1;
+
+        // Team size with the lowest modelled time, 1..max_threads
+        size_t threads_for(double flops) const;
+    };
+
+    // Block-CSR storage for pruned weight matrices. Each stored block is a dense
+    // block_rows x block_cols tile; blocks that are entirely zero are dropped.
+    class BlockSparseMatrix
+    {
+    public:
+        BlockSparseMatrix(const Matrix &dense, size_t block_rows = 1, size_t block_cols = 8);
+
+        size_t rows() const { return rows_; }
+        size_t cols() const { return cols_; }
+        size_t block_rows() const { return block_rows_; }
+        size_t block_cols() const { return block_cols_; }
+        size_t stored_blocks() const { return block_cols_index_.size(); }
+        float density() const; // Fraction of blocks that are stored
+        size_t bytes() const;
+        Matrix to_dense() const;
+
+    private:
+        friend class Matrix;
+
+        size_t rows_, cols_;
+        size_t block_rows_, block_cols_;
+        std::vector<size_t> block_row_offsets_; // Block row -> first stored block
+        std::vector<size_t> block_cols_index_;  // Block column of each stored block
+        std::vector<float> values_;             // block_rows_ * block_cols_ values per stored block
+    };
+
+    // Rank-r factorization W ~= U * V of a projection weight. Held through
+    // shared_ptr so variants built on the same factors share one copy.
+    struct LowRankFactors
+    {
+        Matrix U; // in_dim x rank
+        Matrix V; // rank x out_dim
+
+        size_t rank() const { return U.cols(); }
+    };
+
+    // Projection weight with optional block-sparse or low-rank execution formats.
+    // The dense matrix is the reference used by the serial path until the weight
+    // is replaced by low-rank factors, at which point it is released.
+    class ProjectionWeight
+    {
+    public:
+        ProjectionWeight(size_t rows, size_t cols);
+
+        size_t rows() const { return rows_; }
+        size_t cols() const { return cols_; }
+        // Empty (0 x 0) while a sparse or low-rank form is active; see to_dense()
+        Matrix &dense() { return dense_; }
+        const Matrix &dense() const { return dense_; }
+        const BlockSparseMatrix *sparse() const { return sparse_.get(); }
+        const LowRankFactors *low_rank() const { return low_rank_.get(); }
+
+        Matrix apply_serial(const Matrix &input) const;
+        Matrix apply_parallel(const Matrix &input) const;
+
+        // Magnitude-prune whole blocks until `sparsity` of them are zero. The sparse
+        // kernel is only kept when the resulting density is below `density_threshold`,
+        // and then replaces the dense matrix.
+        void prune(float sparsity, size_t block_rows, size_t block_cols, float density_threshold);
+
+        // Replace the weight by externally computed factors (e.g. from an SVD tool)
+        void set_low_rank(std::shared_ptr<const LowRankFactors> factors);
+
+        // Factorize the dense weight with the smallest rank whose relative Frobenius
+        // error stays within `error_budget`. Returns the chosen rank, or 0 when the
+        // factors would not be cheaper than the dense weight and it is kept.
+        size_t compress_low_rank(float error_budget);
+
+        size_t bytes() const; // Resident bytes of the active format
+
+        // Replace the weight by a dense matrix, dropping any sparse or low-rank form
+        void set_dense(const Matrix &weight);
+        // Dense equivalent of whichever format is active
+        Matrix to_dense() const;
+
+    private:
+        size_t rows_, cols_;
+        Matrix dense_;
+        std::unique_ptr<BlockSparseMatrix> sparse_;
+        std::shared_ptr<const LowRankFactors> low_rank_;
+    };
+
+    // Token embedding lookup fused with the positional encoding add
+    class TokenEmbedding
+    {
+    public:
+        explicit TokenEmbedding(const TransformerConfig &config);
+
+        // Replace the vocab_size x embed_dim table; it is converted to the configured storage
+        void set_table(const Matrix &table);
+        // Replace the learned seq_length x embed_dim positional table
+        void set_positions(const Matrix &positions);
+
+        // Gather table rows for `token_ids` and add positional encodings in the same
+        // pass, writing rows [0, token_ids.size()) of `output`
+        void embed(const std::vector<uint32_t> &token_ids, Matrix &output, bool use_parallel = true) const;
+
+        size_t table_bytes() const;
+
+    private:
+        TransformerConfig config_;
+        std::vector<float> table_f32_;
+        std::vector<uint16_t> table_f16_;
+        std::vector<int8_t> table_i8_;
+        std::vector<float> row_scales_; // Int8 dequantization scale per row
+        Matrix positions_;              // seq_length x embed_dim, precomputed or learned
+
+        // Table rows fetched ahead of the one being converted
+        static constexpr size_t PREFETCH_DISTANCE = 4;
+    };
+
+    // Rotary position embedding tables: cos/sin of position * theta^(-2p / head_dim)
+    // for every (position, frequency p), built once per model and shared by all layers
+    class RotaryTable
+    {
+    public:
+        RotaryTable(size_t max_positions, size_t head_dim, float theta);
+
+        size_t max_positions() const { return max_positions_; }
+        size_t frequencies() const { return frequencies_; }
+        const float *cos_row(size_t position) const { return &cos_[position * frequencies_]; }
+        const float *sin_row(size_t position) const { return &sin_[position * frequencies_]; }
+
+    private:
+        size_t max_positions_, frequencies_;
+        std::vector<float> cos_, sin_;
+    };
+
+    // Parameters of one encoder layer in checkpoint form. Matrices the layer's
+    // attention variant does not use are left 0 x 0.
+    struct LayerWeights
+    {
+        Matrix W_q{0, 0}, W_k{0, 0}, W_v{0, 0}, W_o{0, 0};
+        Matrix linformer_E{0, 0}, linformer_F{0, 0}; // AttentionType::Linformer
+        Matrix relative_bias{0, 0};                  // PositionBias::T5Relative
+        std::vector<Matrix> random_features;         // FeatureMap::RandomFeatures, one per head
+        Matrix W1{0, 0}, b1{0, 0}, W2{0, 0}, b2{0, 0};
+        Matrix norm1_gamma{0, 0}, norm1_beta{0, 0}, norm2_gamma{0, 0}, norm2_beta{0, 0};
+    };
+
+    // Model checkpoint: the config the weights belong to plus every layer. Covers dense
+    // FFN models that take pre-embedded input (num_experts == 0, vocab_size == 0).
+    struct ModelWeights
+    {
+        TransformerConfig config;
+        std::vector<LayerWeights> layers;
+
+        void save(const std::string &path) const;
+        static ModelWeights load(const std::string &path);
     };
 
     // Multi-Head Self-Attention Layer
     class MultiHeadAttention
     {
     public:
-        explicit MultiHeadAttention(const TransformerConfig &config);
-
+        // With rotary_embeddings enabled and no table given, the layer builds its own.
+        // Without initialize_weights every parameter is left zero for set_weights to fill.
+        explicit MultiHeadAttention(const TransformerConfig &config,
+                                    std::shared_ptr<const RotaryTable> rotary = nullptr,
+                                    bool initialize_weights = true);
+
+        // With key_importance given and TokenReduction::Prune, it receives the mean
+        // attention each key row got in this call, averaged over heads and queries
         Matrix forward(const Matrix &input, bool use_parallel = true);
-        Matrix forward_serial(const Matrix &input);
-        Matrix forward_parallel(const Matrix &input);
+        Matrix forward_serial(const Matrix &input, std::vector<float> *key_importance = nullptr);
+        Matrix forward_parallel(const Matrix &input, std::vector<float> *key_importance = nullptr);
+
+        // Attention output for the first `query_rows` rows only; keys and values still
+        // cover every input row
+        Matrix forward_queries(const Matrix &input, size_t query_rows, bool use_parallel = true);
+
+        void prune_weights(float sparsity);
+        void compress_low_rank(float error_budget);
+        size_t weight_bytes() const;
+
+        void set_weights(const LayerWeights &weights);
+        void export_weights(LayerWeights &weights) const;
 
     private:
         TransformerConfig config_;
         size_t head_dim_;
 
         // Weight matrices
-        Matrix W_q_, W_k_, W_v_, W_o_;
+        ProjectionWeight W_q_, W_k_, W_v_, W_o_;
+
+        // Linformer sequence projections for K and V (linformer_rank x seq_length)
+        Matrix E_, F_;
+
+        std::shared_ptr<const RotaryTable> rotary_;
+
+        // Position bias state: ALiBi slopes per head, or the T5 bucket of every
+        // relative distance (j - i + seq_length - 1) and the buckets x heads bias table
+        std::vector<float> alibi_slopes_;
+        std::vector<uint32_t> relative_bucket_;
+        Matrix relative_bias_;
+
+        // Per-head Gaussian projections for random-feature linear attention (head_dim x features)
+        std::vector<Matrix> random_features_;
 
         // Helper functions
-        Matrix scaled_dot_product_attention(const Matrix &Q, const Matrix &K, const Matrix &V, bool use_parallel = true);
+        Matrix attend_serial(const Matrix &input, size_t query_rows, std::vector<float> *key_importance);
+        Matrix attend_parallel(const Matrix &input, size_t query_rows, std::vector<float> *key_importance);
+        // With head_importance given, it receives the column sums of the attention weights
+        Matrix scaled_dot_product_attention(const Matrix &Q, const Matrix &K, const Matrix &V, size_t head,
+                                            bool use_parallel = true, std::vector<float> *head_importance = nullptr) const;
+        Matrix linear_attention(const Matrix &Q, const Matrix &K, const Matrix &V, size_t head, bool use_parallel = true) const;
+        Matrix feature_map(const Matrix &input, size_t head, bool is_query, bool use_parallel) const;
+        Matrix project_sequence(const Matrix &projection, const Matrix &input, bool use_parallel) const;
+        void collect_key_importance(const std::vector<std::vector<float>> &head_importance, size_t num_queries,
+                                    std::vector<float> &key_importance) const;
         Matrix softmax(const Matrix &input, bool use_parallel = true) const;
-        void split_heads(const Matrix &input, std::vector<Matrix> &heads) const;
+        float position_bias(size_t head, size_t query, size_t key) const;
+        void split_heads(const Matrix &input, std::vector<Matrix> &heads, bool rotate = false) const;
         Matrix concat_heads(const std::vector<Matrix> &heads) const;
     };
 
@@ -81,17 +386,55 @@ namespace MicroTransformer
     class FeedForwardNetwork
     {
     public:
-        explicit FeedForwardNetwork(const TransformerConfig &config);
+        explicit FeedForwardNetwork(const TransformerConfig &config, bool initialize_weights = true);
 
         Matrix forward(const Matrix &input, bool use_parallel = true);
         Matrix forward_serial(const Matrix &input);
         Matrix forward_parallel(const Matrix &input);
 
+        void prune_weights(float sparsity);
+        void compress_low_rank(float error_budget);
+        size_t weight_bytes() const;
+
+        void set_weights(const LayerWeights &weights);
+        void export_weights(LayerWeights &weights) const;
+
     private:
         TransformerConfig config_;
-        Matrix W1_, b1_, W2_, b2_;
+        ProjectionWeight W1_, W2_;
+        Matrix b1_, b2_;
+
+        // Rows of activations that share one active-unit bitmask in the down-projection
+        static constexpr size_t ACTIVATION_ROW_BLOCK = 8;
 
         Matrix relu(const Matrix &input, bool use_parallel = true) const;
+        Matrix masked_down_projection(const Matrix &activated, const std::vector<uint64_t> &active_mask) const;
+    };
+
+    // Mixture-of-experts feed-forward layer: a router picks the top-k experts for
+    // every row, rows are grouped per expert and the weighted expert outputs combined
+    class MixtureOfExperts
+    {
+    public:
+        explicit MixtureOfExperts(const TransformerConfig &config);
+
+        Matrix forward(const Matrix &input, bool use_parallel = true);
+        Matrix forward_serial(const Matrix &input);
+        Matrix forward_parallel(const Matrix &input);
+
+        void prune_weights(float sparsity);
+        void compress_low_rank(float error_budget);
+        size_t weight_bytes() const;
+
+    private:
+        TransformerConfig config_;
+        Matrix router_; // embed_dim x num_experts
+        std::vector<std::unique_ptr<FeedForwardNetwork>> experts_;
+
+        // Rows per expert work item in the parallel dispatch
+        static constexpr size_t EXPERT_ROW_BLOCK = 64;
+
+        Matrix dispatch(const Matrix &input, bool use_parallel);
     };
 
     // Layer Normalization
@@ -104,6 +447,15 @@ namespace MicroTransformer
         Matrix forward_serial(const Matrix &input);
         Matrix forward_parallel(const Matrix &input);
 
+        // Normalize and pool in one pass without storing the normalized rows (1 x cols)
+        Matrix forward_pooled(const Matrix &input, Pooling pooling, bool use_parallel = true);
+
+        size_t weight_bytes() const { return gamma_.bytes() + beta_.bytes(); }
+
+        const Matrix &gamma() const { return gamma_; }
+        const Matrix &beta() const { return beta_; }
+        void set_parameters(const Matrix &gamma, const Matrix &beta);
+
     private:
         TransformerConfig config_;
         Matrix gamma_, beta_;
@@ -113,17 +465,65 @@ namespace MicroTransformer
     class TransformerEncoderLayer
     {
     public:
-        explicit TransformerEncoderLayer(const TransformerConfig &config);
+        explicit TransformerEncoderLayer(const TransformerConfig &config,
+                                         std::shared_ptr<const RotaryTable> rotary = nullptr,
+                                         bool initialize_weights = true);
 
+        // key_importance as in MultiHeadAttention; filled only for TokenReduction::Prune
         Matrix forward(const Matrix &input, bool use_parallel = true);
-        Matrix forward_serial(const Matrix &input);
-        Matrix forward_parallel(const Matrix &input);
+        Matrix forward_serial(const Matrix &input, std::vector<float> *key_importance = nullptr);
+        Matrix forward_parallel(const Matrix &input, std::vector<float> *key_importance = nullptr);
+
+        void prune_weights(float sparsity);
+        void compress_low_rank(float error_budget);
+        size_t weight_bytes() const;
+
+        void set_weights(const LayerWeights &weights);
+        LayerWeights export_weights() const;
+
+        // Size each operator's team in forward_parallel from the model (nullptr = caller's setting)
+        void set_thread_model(std::shared_ptr<const ThreadCostModel> model) { thread_model_ = std::move(model); }
+
+        // Pooled layer output; for CLS only row 0 goes through queries, FFN and norms
+        Matrix forward_pooled(const Matrix &input, Pooling pooling, bool use_parallel = true);
 
     private:
         TransformerConfig config_;
         std::unique_ptr<MultiHeadAttention> attention_;
-        std::unique_ptr<FeedForwardNetwork> ffn_;
+        std::unique_ptr<FeedForwardNetwork> ffn_; // Set when num_experts == 0
+        std::unique_ptr<MixtureOfExperts> moe_;   // Set when num_experts > 0
         std::unique_ptr<LayerNorm> norm1_, norm2_;
+        std::shared_ptr<const ThreadCostModel> thread_model_;
+
+        // Team sizes for one forward; 0 keeps the caller's thread count. A plan never
+        // exceeds the caller's team, so an outer limit (e.g. a registry slot) still holds
+        struct OpThreads
+        {
+            int attention, feed_forward, norm;
+        };
+        OpThreads plan_threads(size_t rows) const;
+    };
+
+    // Encoder output after token reduction, with the row each input token ended up in
+    struct ReducedOutput
+    {
+        static constexpr size_t DROPPED_TOKEN = static_cast<size_t>(-1);
+
+        Matrix output;
+        std::vector<size_t> token_rows; // Input token -> output row, or DROPPED_TOKEN if pruned
+    };
+
+    // Per-request early exit: stop once a layer barely changes the pooled representation
+    struct EarlyExitOptions
+    {
+        float cosine_threshold = 0.99f; // Exit when cos(pooled_prev, pooled_next) reaches this
+        size_t min_layers = 1;          // Layers that always run before the probe may stop
+    };
+
+    struct EarlyExitOutput
+    {
+        Matrix output;
+        size_t layers_used;
     };
 
     // Complete Transformer Encoder
@@ -131,48 +531,161 @@ namespace MicroTransformer
     {
     public:
         explicit TransformerEncoder(const TransformerConfig &config);
+        // Encoder for weights.config initialized from the checkpoint
+        explicit TransformerEncoder(const ModelWeights &weights);
 
+        // With token reduction enabled these return the reduced rows
         Matrix forward(const Matrix &input, bool use_parallel = true);
         Matrix forward_serial(const Matrix &input);
         Matrix forward_parallel(const Matrix &input);
 
+        // Inter-sequence parallelism for models too small to split: each OpenMP thread runs
+        // whole serial forwards on its share of the inputs against the shared weights
+        std::vector<Matrix> forward_batch(const std::vector<Matrix> &inputs);
+
+        // Token id input; requires vocab_size > 0. Embeddings are written into the buffer
+        // the first layer reads, without an intermediate copy
+        Matrix forward_tokens(const std::vector<uint32_t> &token_ids, bool use_parallel = true);
+        TokenEmbedding &embedding();
+
+        // Pooled output (1 x embed_dim); the last layer skips rows the pooling never reads
+        Matrix forward(const Matrix &input, Pooling pooling, bool use_parallel = true);
+
+        // Forward pass that also reports where every input token ended up
+        ReducedOutput forward_reduced(const Matrix &input, bool use_parallel = true);
+
+        // Forward pass that may stop before num_layers and reports how many layers ran
+        EarlyExitOutput forward_early_exit(const Matrix &input, const EarlyExitOptions &options,
+                                           bool use_parallel = true);
+
+        // Prune every projection weight to the given block sparsity (0..1)
+        void prune_weights(float sparsity);
+
+        // Replace every projection weight by a low-rank factorization whose relative
+        // error is within `error_budget`, picking the rank per weight
+        void compress_low_rank(float error_budget);
+
+        // Resident parameter memory, including the embedding table
+        size_t weight_bytes() const;
+
+        // Pick the thread count of every parallel operator from its size instead of
+        // always using the full team; nullptr restores the default
+        void set_thread_model(std::shared_ptr<const ThreadCostModel> model);
+
+        // Checkpoint of every layer's parameters; see ModelWeights for what is covered
+        ModelWeights export_weights() const;
+
         const TransformerConfig &get_config() const { return config_; }
 
     private:
         TransformerConfig config_;
+        std::unique_ptr<TokenEmbedding> embedding_; // Set when vocab_size > 0
         std::vector<std::unique_ptr<TransformerEncoderLayer>> layers_;
+
+        // Builds the layers; the checkpoint constructor skips their random init
+        TransformerEncoder(const TransformerConfig &config, bool initialize_weights);
+
+        Matrix run_layers(const Matrix &input, bool use_parallel, std::vector<size_t> *token_rows,
+                          const EarlyExitOptions *early_exit = nullptr, size_t *layers_used = nullptr,
+                          Pooling pooling = Pooling::None);
+        static std::vector<float> mean_pool(const Matrix &rows, bool use_parallel);
+        Matrix prune_tokens(const Matrix &rows, const std::vector<float> &importance,
+                            std::vector<size_t> &new_row_of) const;
+        Matrix merge_tokens(const Matrix &rows, std::vector<float> &token_sizes,
+                            std::vector<size_t> &new_row_of, bool use_parallel) const;
     };
 
     // Performance measurement utilities
+
+    // Elementwise error of a result against its reference; NaN differences count as infinite
+    struct ComparisonStats
+    {
+        bool shapes_match = true;
+        double max_abs_error = 0.0;
+        double max_rel_error = 0.0;     // |result - reference| / |reference|, floored at FLT_MIN
+        uint64_t max_ulp_distance = 0;  // Representable floats between the two values
+        double rms_error = 0.0;
+        size_t worst_row = 0, worst_col = 0; // Element with the largest absolute error
+    };
+
     struct BenchmarkResult
     {
         double execution_time_ms;
+        double cold_execution_time_ms = 0.0; // Caches flushed before every run (0 = not measured)
         size_t thread_count;
         std::string implementation_type;
         TransformerConfig config;
         bool numerical_correctness;
         double max_deviation;
+        ComparisonStats comparison; // Parallel output against serial (zero for serial runs)
+    };
+
+    // Environment of each point of a process-isolated sweep
+    struct SweepOptions
+    {
+        std::string proc_bind = "close"; // OMP_PROC_BIND (empty = inherit)
+        std::string places = "cores";    // OMP_PLACES (empty = inherit)
+        bool measure_cold = false;
     };
 
     class PerformanceBenchmark
     {
     public:
+        // Largest elementwise serial/parallel difference still counted as correct
+        static constexpr float CORRECTNESS_TOLERANCE = 1e-4f;
+
+        // Back-to-back runs measure the warm latency; with measure_cold every run is
+        // also repeated after Utils::flush_caches, as when other tenants evicted the weights
         static BenchmarkResult measure_execution(
             TransformerEncoder &encoder,
             const Matrix &input,
             bool use_parallel = true,
-            size_t num_runs = 10);
+            size_t num_runs = 10,
+            bool measure_cold = false);
 
         static std::vector<BenchmarkResult> scalability_test(
             const TransformerConfig &base_config,
             const std::vector<size_t> &thread_counts,
             const std::vector<size_t> &sequence_lengths,
-            size_t num_runs = 5);
+            size_t num_runs = 5,
+            bool measure_cold = false);
+
+        // Same sweep as scalability_test, but every (sequence length, thread count) point
+        // runs in a fresh child of `executable` with its own OpenMP environment, so no
+        // thread pool, heap state or page placement carries over between points. Only
+        // the shape fields of base_config reach the children. POSIX only.
+        static std::vector<BenchmarkResult> isolated_scalability_test(
+            const std::string &executable,
+            const TransformerConfig &base_config,
+            const std::vector<size_t> &thread_counts,
+            const std::vector<size_t> &sequence_lengths,
+            size_t num_runs = 5,
+            const SweepOptions &options = {});
+
+        // Child side of isolated_scalability_test: `executable` must call this when
+        // argv[1] is "--sweep-point" and exit with the returned status
+        static int run_sweep_point(int argc, char **argv);
+
+        // Largest block density at which multiply_sparse still beats multiply_blocked
+        // for this configuration's FFN shape; suitable for sparse_density_threshold.
+        static float calibrate_sparse_density_threshold(
+            const TransformerConfig &config,
+            size_t num_runs = 3);
+
+        // Measure single-thread GEMM throughput and fork/join cost for ThreadCostModel
+        static ThreadCostModel calibrate_thread_model(size_t num_runs = 200);
+
+        // Process-wide model from one calibrate_thread_model run, done on first use
+        static std::shared_ptr<const ThreadCostModel> shared_thread_model();
 
+        // Single parallel, vectorized pass over both matrices
+        static ComparisonStats compare_results(const Matrix &reference, const Matrix &result);
+
+        // True when the shapes match and no element differs by more than `tolerance`
         static bool verify_numerical_correctness(
             const Matrix &serial_result,
             const Matrix &parallel_result,
-            float tolerance = 1e-4f);
+            float tolerance = CORRECTNESS_TOLERANCE);
 
         static void save_results_to_csv(
             const std::vector<BenchmarkResult> &results,
@@ -187,6 +700,24 @@ namespace MicroTransformer
         Matrix generate_random_input(size_t seq_length, size_t embed_dim, float min = -1.0f, float max = 1.0f);
         void print_matrix_stats(const Matrix &matrix, const std::string &name);
         double get_wall_time();
+
+        // Evict weights and activations from every core's caches by sweeping a buffer
+        // larger than the last-level cache from all threads
+        void flush_caches(size_t buffer_bytes = size_t{64} << 20);
+
+        // Sets the calling thread's OpenMP team size for the scope; 0 leaves it unchanged
+        class ScopedThreadCount
+        {
+        public:
+            explicit ScopedThreadCount(int num_threads);
+            ~ScopedThreadCount();
+
+            ScopedThreadCount(const ScopedThreadCount &) = delete;
+            ScopedThreadCount &operator=(const ScopedThreadCount &) = delete;
+
+        private:
+            int previous_;
+        };
     }
 
 } // namespace MicroTransformer
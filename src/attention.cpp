@@ -1,17 +1,46 @@
 #include "transformer.h"
 #include <cmath>
 #include <algorithm>
+#include <random>
+#include <cstdlib>
 #include <omp.h>
 
 namespace MicroTransformer
 {
 
-    MultiHeadAttention::MultiHeadAttention(const TransformerConfig &config)
+    // Rotary Table Implementation
+    RotaryTable::RotaryTable(size_t max_positions, size_t head_dim, float theta)
+        : max_positions_(max_positions), frequencies_(head_dim / 2),
+          cos_(max_positions * (head_dim / 2)), sin_(max_positions * (head_dim / 2))
+    {
+        if (head_dim % 2 != 0)
+        {
+            throw std::invalid_argument("Rotary embeddings require an even head dimension");
+        }
+
+        for (size_t pos = 0; pos < max_positions; ++pos)
+        {
+            for (size_t p = 0; p < frequencies_; ++p)
+            {
+                double angle = static_cast<double>(pos) *
+                               std::pow(static_cast<double>(theta), -2.0 * static_cast<double>(p) / static_cast<double>(head_dim));
+                cos_[pos * frequencies_ + p] = static_cast<float>(std::cos(angle));
+                sin_[pos * frequencies_ + p] = static_cast<float>(std::sin(angle));
+            }
+        }
+    }
+
+    MultiHeadAttention::MultiHeadAttention(const TransformerConfig &config, std::shared_ptr<const RotaryTable> rotary,
+                                           bool initialize_weights)
         : config_(config), head_dim_(config.embed_dim / config.num_heads),
           W_q_(config.embed_dim, config.embed_dim),
           W_k_(config.embed_dim, config.embed_dim),
           W_v_(config.embed_dim, config.embed_dim),
-          W_o_(config.embed_dim, config.embed_dim)
+          W_o_(config.embed_dim, config.embed_dim),
+          E_(config.attention_type == AttentionType::Linformer ? config.linformer_rank : 0, config.seq_length),
+          F_(config.attention_type == AttentionType::Linformer ? config.linformer_rank : 0, config.seq_length),
+          rotary_(std::move(rotary)),
+          relative_bias_(config.position_bias == PositionBias::T5Relative ? config.relative_buckets : 0, config.num_heads)
     {
 
         if (config.embed_dim % config.num_heads != 0)
@@ -19,12 +48,134 @@ namespace MicroTransformer
             throw std::invalid_argument("embed_dim must be divisible by num_heads");
         }
 
+        if (config.rotary_embeddings)
+        {
+            if (config.attention_type == AttentionType::Linformer)
+            {
+                throw std::invalid_argument("Rotary embeddings need per-position keys, which Linformer projects away");
+            }
+            if (!rotary_)
+            {
+                rotary_ = std::make_shared<RotaryTable>(config.seq_length, head_dim_, config.rope_theta);
+            }
+        }
+
         // Initialize weights with Xavier/Glorot initialization
-        float limit = std::sqrt(6.0f / (config.embed_dim + config.embed_dim));
-        W_q_.randomize(-limit, limit);
-        W_k_.randomize(-limit, limit);
-        W_v_.randomize(-limit, limit);
-        W_o_.randomize(-limit, limit);
+        if (initialize_weights)
+        {
+            float limit = std::sqrt(6.0f / (config.embed_dim + config.embed_dim));
+            W_q_.dense().randomize(-limit, limit);
+            W_k_.dense().randomize(-limit, limit);
+            W_v_.dense().randomize(-limit, limit);
+            W_o_.dense().randomize(-limit, limit);
+        }
+
+        if (config.position_bias != PositionBias::None)
+        {
+            if (config.attention_type != AttentionType::Softmax)
+            {
+                throw std::invalid_argument("Position biases require softmax attention over all keys");
+            }
+
+            if (config.position_bias == PositionBias::ALiBi)
+            {
+                // Slopes 2^(-8h/n) for the closest power of two n, with the remaining
+                // heads interleaved from the 2n sequence (Press et al.)
+                size_t closest = 1;
+                while (closest * 2 <= config.num_heads)
+                {
+                    closest *= 2;
+                }
+                for (size_t h = 0; h < closest; ++h)
+                {
+                    alibi_slopes_.push_back(std::pow(2.0f, -8.0f * static_cast<float>(h + 1) / static_cast<float>(closest)));
+                }
+                for (size_t h = 0; alibi_slopes_.size() < config.num_heads; ++h)
+                {
+                    alibi_slopes_.push_back(std::pow(2.0f, -4.0f * static_cast<float>(2 * h + 1) / static_cast<float>(closest)));
+                }
+            }
+            else
+            {
+                // The logarithmic range starts at relative_buckets / 4 and must end past it
+                if (config.relative_buckets < 4 || config.relative_max_distance <= config.relative_buckets / 4)
+                {
+                    throw std::invalid_argument("T5 relative bias needs at least 4 buckets and a max distance above relative_buckets / 4");
+                }
+
+                // Bidirectional T5 bucketing: half the buckets per direction, exact for
+                // small distances and logarithmic up to relative_max_distance
+                const size_t half = config.relative_buckets / 2;
+                const size_t max_exact = half / 2;
+                relative_bucket_.resize(2 * config.seq_length - 1);
+                for (size_t d = 0; d < relative_bucket_.size(); ++d)
+                {
+                    long relative = static_cast<long>(d) - static_cast<long>(config.seq_length - 1);
+                    size_t distance = static_cast<size_t>(std::labs(relative));
+                    size_t bucket = distance;
+                    if (distance >= max_exact)
+                    {
+                        float ratio = std::log(static_cast<float>(distance) / static_cast<float>(max_exact)) /
+                                      std::log(static_cast<float>(config.relative_max_distance) / static_cast<float>(max_exact));
+                        ratio = std::clamp(ratio, 0.0f, 1.0f);
+                        bucket = std::min(half - 1, max_exact + static_cast<size_t>(ratio * static_cast<float>(half - max_exact)));
+                    }
+                    relative_bucket_[d] = static_cast<uint32_t>(bucket + (relative > 0 ? half : 0));
+                }
+
+                if (initialize_weights)
+                {
+                    relative_bias_.randomize(-0.1f, 0.1f);
+                }
+            }
+        }
+
+        if (config.attention_type == AttentionType::Linformer)
+        {
+            if (config.linformer_rank == 0)
+            {
+                throw std::invalid_argument("linformer_rank must be positive");
+            }
+
+            // Random sequence projections with N(0, 1/k) entries (overwritten when trained ones are loaded)
+            if (initialize_weights)
+            {
+                std::random_device rd;
+                std::mt19937 gen(rd());
+                std::normal_distribution<float> dis(0.0f, 1.0f / std::sqrt(static_cast<float>(config.linformer_rank)));
+                for (Matrix *projection : {&E_, &F_})
+                {
+                    for (size_t i = 0; i < projection->rows() * projection->cols(); ++i)
+                    {
+                        projection->data()[i] = dis(gen);
+                    }
+                }
+            }
+        }
+
+        if (config.attention_type == AttentionType::Linear && config.feature_map == FeatureMap::RandomFeatures)
+        {
+            if (config.num_random_features == 0)
+            {
+                throw std::invalid_argument("num_random_features must be positive");
+            }
+
+            // Performer projections are drawn from N(0, I)
+            std::random_device rd;
+            std::mt19937 gen(rd());
+            std::normal_distribution<float> dis(0.0f, 1.0f);
+
+            random_features_.reserve(config.num_heads);
+            for (size_t h = 0; h < config.num_heads; ++h)
+            {
+                Matrix projection(head_dim_, config.num_random_features);
+                for (size_t i = 0; initialize_weights && i < projection.rows() * projection.cols(); ++i)
+                {
+                    projection.data()[i] = dis(gen);
+                }
+                random_features_.push_back(std::move(projection));
+            }
+        }
     }
 
     Matrix MultiHeadAttention::forward(const Matrix &input, bool use_parallel)
@@ -39,86 +190,163 @@ namespace MicroTransformer
         }
     }
 
-    Matrix MultiHeadAttention::forward_serial(const Matrix &input)
+    Matrix MultiHeadAttention::forward_serial(const Matrix &input, std::vector<float> *key_importance)
     {
-        // Linear transformations to get Q, K, V
-        Matrix Q = input * W_q_;
-        Matrix K = input * W_k_;
-        Matrix V = input * W_v_;
+        return attend_serial(input, input.rows(), key_importance);
+    }
+
+    Matrix MultiHeadAttention::forward_parallel(const Matrix &input, std::vector<float> *key_importance)
+    {
+        return attend_parallel(input, input.rows(), key_importance);
+    }
+
+    Matrix MultiHeadAttention::forward_queries(const Matrix &input, size_t query_rows, bool use_parallel)
+    {
+        if (query_rows == 0 || query_rows > input.rows())
+        {
+            throw std::invalid_argument("query_rows must be in [1, input rows]");
+        }
+
+        return use_parallel ? attend_parallel(input, query_rows, nullptr) : attend_serial(input, query_rows, nullptr);
+    }
+
+    Matrix MultiHeadAttention::attend_serial(const Matrix &input, size_t query_rows, std::vector<float> *key_importance)
+    {
+        // Linear transformations to get Q, K, V. Linformer projects the input along the
+        // sequence axis first, so K and V are only ever produced with linformer_rank rows
+        Matrix Q = query_rows == input.rows() ? W_q_.apply_serial(input)
+                                              : W_q_.apply_serial(input.row_range(0, query_rows));
+        Matrix K = config_.attention_type == AttentionType::Linformer
+                       ? W_k_.apply_serial(project_sequence(E_, input, false))
+                       : W_k_.apply_serial(input);
+        Matrix V = config_.attention_type == AttentionType::Linformer
+                       ? W_v_.apply_serial(project_sequence(F_, input, false))
+                       : W_v_.apply_serial(input);
 
         // Split into multiple heads
-        std::vector<Matrix> Q_heads(config_.num_heads, Matrix(config_.seq_length, head_dim_));
-        std::vector<Matrix> K_heads(config_.num_heads, Matrix(config_.seq_length, head_dim_));
-        std::vector<Matrix> V_heads(config_.num_heads, Matrix(config_.seq_length, head_dim_));
+        std::vector<Matrix> Q_heads(config_.num_heads, Matrix(Q.rows(), head_dim_));
+        std::vector<Matrix> K_heads(config_.num_heads, Matrix(K.rows(), head_dim_));
+        std::vector<Matrix> V_heads(config_.num_heads, Matrix(V.rows(), head_dim_));
 
-        split_heads(Q, Q_heads);
-        split_heads(K, K_heads);
+        split_heads(Q, Q_heads, true);
+        split_heads(K, K_heads, true);
         split_heads(V, V_heads);
 
-        // Apply attention for each head
-        std::vector<Matrix> attention_outputs(config_.num_heads, Matrix(config_.seq_length, head_dim_));
+        // Apply attention for each head. Importance lives in this call only, so
+        // concurrent forwards on one module never share it
+        const bool track = key_importance && config_.token_reduction == TokenReduction::Prune;
+        std::vector<std::vector<float>> head_importance(track ? config_.num_heads : 0);
+        std::vector<Matrix> attention_outputs(config_.num_heads, Matrix(Q.rows(), head_dim_));
         for (size_t h = 0; h < config_.num_heads; ++h)
         {
-            attention_outputs[h] = scaled_dot_product_attention(Q_heads[h], K_heads[h], V_heads[h], false);
+            attention_outputs[h] = scaled_dot_product_attention(Q_heads[h], K_heads[h], V_heads[h], h, false,
+                                                                track ? &head_importance[h] : nullptr);
+        }
+        if (track)
+        {
+            collect_key_importance(head_importance, Q.rows(), *key_importance);
         }
 
         // Concatenate heads
         Matrix concat_output = concat_heads(attention_outputs);
 
         // Final linear transformation
-        return concat_output * W_o_;
+        return W_o_.apply_serial(concat_output);
     }
 
-    Matrix MultiHeadAttention::forward_parallel(const Matrix &input)
+    Matrix MultiHeadAttention::attend_parallel(const Matrix &input, size_t query_rows, std::vector<float> *key_importance)
     {
         // Linear transformations to get Q, K, V in parallel using sections
-        Matrix Q(input.rows(), W_q_.cols());
-        Matrix K(input.rows(), W_k_.cols());
-        Matrix V(input.rows(), W_v_.cols());
+        const bool linformer = config_.attention_type == AttentionType::Linformer;
+        Matrix Q(query_rows, W_q_.cols());
+        Matrix K(linformer ? E_.rows() : input.rows(), W_k_.cols());
+        Matrix V(linformer ? F_.rows() : input.rows(), W_v_.cols());
 
 #pragma omp parallel sections
         {
 #pragma omp section
             {
-                Q = input.multiply_blocked(W_q_);
+                Q = query_rows == input.rows() ? W_q_.apply_parallel(input)
+                                               : W_q_.apply_parallel(input.row_range(0, query_rows));
             }
 #pragma omp section
             {
-                K = input.multiply_blocked(W_k_);
+                K = linformer ? W_k_.apply_parallel(project_sequence(E_, input, true)) : W_k_.apply_parallel(input);
             }
 #pragma omp section
             {
-                V = input.multiply_blocked(W_v_);
+                V = linformer ? W_v_.apply_parallel(project_sequence(F_, input, true)) : W_v_.apply_parallel(input);
             }
         }
 
         // Split into multiple heads
-        std::vector<Matrix> Q_heads(config_.num_heads, Matrix(config_.seq_length, head_dim_));
-        std::vector<Matrix> K_heads(config_.num_heads, Matrix(config_.seq_length, head_dim_));
-        std::vector<Matrix> V_heads(config_.num_heads, Matrix(config_.seq_length, head_dim_));
+        std::vector<Matrix> Q_heads(config_.num_heads, Matrix(Q.rows(), head_dim_));
+        std::vector<Matrix> K_heads(config_.num_heads, Matrix(K.rows(), head_dim_));
+        std::vector<Matrix> V_heads(config_.num_heads, Matrix(V.rows(), head_dim_));
 
-        split_heads(Q, Q_heads);
-        split_heads(K, K_heads);
+        split_heads(Q, Q_heads, true);
+        split_heads(K, K_heads, true);
         split_heads(V, V_heads);
 
         // Apply attention for each head in parallel
-        std::vector<Matrix> attention_outputs(config_.num_heads, Matrix(config_.seq_length, head_dim_));
+        const bool track = key_importance && config_.token_reduction == TokenReduction::Prune;
+        std::vector<std::vector<float>> head_importance(track ? config_.num_heads : 0);
+        std::vector<Matrix> attention_outputs(config_.num_heads, Matrix(Q.rows(), head_dim_));
 
 #pragma omp parallel for if (config_.num_heads > 1)
         for (size_t h = 0; h < config_.num_heads; ++h)
         {
-            attention_outputs[h] = scaled_dot_product_attention(Q_heads[h], K_heads[h], V_heads[h], true);
+            attention_outputs[h] = scaled_dot_product_attention(Q_heads[h], K_heads[h], V_heads[h], h, true,
+                                                                track ? &head_importance[h] : nullptr);
+        }
+        if (track)
+        {
+            collect_key_importance(head_importance, Q.rows(), *key_importance);
         }
 
         // Concatenate heads
         Matrix concat_output = concat_heads(attention_outputs);
 
         // Final linear transformation with blocked multiplication
-        return concat_output.multiply_blocked(W_o_);
+        return W_o_.apply_parallel(concat_output);
     }
 
-    Matrix MultiHeadAttention::scaled_dot_product_attention(const Matrix &Q, const Matrix &K, const Matrix &V, bool use_parallel)
+    void MultiHeadAttention::prune_weights(float sparsity)
     {
+        for (ProjectionWeight *weight : {&W_q_, &W_k_, &W_v_, &W_o_})
+        {
+            weight->prune(sparsity, config_.sparse_block_rows, config_.sparse_block_cols,
+                          config_.sparse_density_threshold);
+        }
+    }
+
+    void MultiHeadAttention::compress_low_rank(float error_budget)
+    {
+        for (ProjectionWeight *weight : {&W_q_, &W_k_, &W_v_, &W_o_})
+        {
+            weight->compress_low_rank(error_budget);
+        }
+    }
+
+    size_t MultiHeadAttention::weight_bytes() const
+    {
+        size_t total = W_q_.bytes() + W_k_.bytes() + W_v_.bytes() + W_o_.bytes() +
+                       E_.bytes() + F_.bytes() + relative_bias_.bytes();
+        for (const Matrix &features : random_features_)
+        {
+            total += features.bytes();
+        }
+        return total;
+    }
+
+    Matrix MultiHeadAttention::scaled_dot_product_attention(const Matrix &Q, const Matrix &K, const Matrix &V, size_t head,
+                                                            bool use_parallel, std::vector<float> *head_importance) const
+    {
+        if (config_.attention_type == AttentionType::Linear)
+        {
+            return linear_attention(Q, K, V, head, use_parallel);
+        }
+
         // Compute attention scores: Q * K^T
         Matrix K_T = K.transpose();
         Matrix scores(Q.rows(), K.rows());
@@ -138,7 +366,7 @@ namespace MicroTransformer
                     {
                         sum += Q(i, k) * K_T(k, j);
                     }
-                    scores(i, j) = sum * scale;
+                    scores(i, j) = sum * scale + position_bias(head, i, j);
                 }
             }
         }
@@ -153,7 +381,7 @@ namespace MicroTransformer
                     {
                         sum += Q(i, k) * K_T(k, j);
                     }
-                    scores(i, j) = sum * scale;
+                    scores(i, j) = sum * scale + position_bias(head, i, j);
                 }
             }
         }
@@ -161,10 +389,195 @@ namespace MicroTransformer
         // Apply softmax to get attention weights
         Matrix attention_weights = softmax(scores, use_parallel);
 
+        if (head_importance)
+        {
+            std::vector<float> &importance = *head_importance;
+            importance.assign(attention_weights.cols(), 0.0f);
+            for (size_t i = 0; i < attention_weights.rows(); ++i)
+            {
+#pragma omp simd
+                for (size_t j = 0; j < attention_weights.cols(); ++j)
+                {
+                    importance[j] += attention_weights(i, j);
+                }
+            }
+        }
+
         // Apply attention weights to values: attention_weights * V
         return attention_weights * V;
     }
 
+    Matrix MultiHeadAttention::linear_attention(const Matrix &Q, const Matrix &K, const Matrix &V, size_t head, bool use_parallel) const
+    {
+        Matrix phi_Q = feature_map(Q, head, true, use_parallel);
+        Matrix phi_K = feature_map(K, head, false, use_parallel);
+
+        // Per-head summary phi(K)^T V (features x head_dim) and normalizer phi(K)^T 1,
+        // so the cost is linear in sequence length
+        Matrix phi_K_T = phi_K.transpose();
+        Matrix kv = use_parallel ? phi_K_T.multiply_blocked(V) : phi_K_T * V;
+        std::vector<float> key_sum(phi_K.cols(), 0.0f);
+        for (size_t i = 0; i < phi_K.rows(); ++i)
+        {
+            for (size_t j = 0; j < phi_K.cols(); ++j)
+            {
+                key_sum[j] += phi_K(i, j);
+            }
+        }
+
+        Matrix output = use_parallel ? phi_Q.multiply_blocked(kv) : phi_Q * kv;
+
+#pragma omp parallel for if (use_parallel)
+        for (size_t i = 0; i < output.rows(); ++i)
+        {
+            float normalizer = 0.0f;
+#pragma omp simd reduction(+ : normalizer)
+            for (size_t j = 0; j < phi_Q.cols(); ++j)
+            {
+                normalizer += phi_Q(i, j) * key_sum[j];
+            }
+
+            float inv = 1.0f / (normalizer + 1e-12f);
+            for (size_t j = 0; j < output.cols(); ++j)
+            {
+                output(i, j) *= inv;
+            }
+        }
+
+        return output;
+    }
+
+    Matrix MultiHeadAttention::feature_map(const Matrix &input, size_t head, bool is_query, bool use_parallel) const
+    {
+        if (config_.feature_map == FeatureMap::EluPlusOne)
+        {
+            Matrix result(input.rows(), input.cols());
+
+#pragma omp parallel for if (use_parallel)
+            for (size_t i = 0; i < input.rows() * input.cols(); ++i)
+            {
+                float x = input.data()[i];
+                result.data()[i] = x > 0.0f ? x + 1.0f : std::exp(x);
+            }
+
+            return result;
+        }
+
+        // Positive random features: phi(x) = exp(w^T x' - |x'|^2 / 2) / sqrt(m) with
+        // x' = x / d^(1/4), so that phi(q) . phi(k) estimates exp(q . k / sqrt(d))
+        const Matrix &projection = random_features_[head];
+        const float input_scale = 1.0f / std::sqrt(std::sqrt(static_cast<float>(head_dim_)));
+        const float output_scale = 1.0f / std::sqrt(static_cast<float>(projection.cols()));
+
+        Matrix projected = use_parallel ? input.multiply_blocked(projection) : input * projection;
+
+        std::vector<float> half_norm(input.rows(), 0.0f);
+        float global_max = -INFINITY;
+
+#pragma omp parallel for if (use_parallel) reduction(max : global_max)
+        for (size_t i = 0; i < input.rows(); ++i)
+        {
+            float norm = 0.0f;
+            for (size_t j = 0; j < input.cols(); ++j)
+            {
+                norm += input(i, j) * input(i, j);
+            }
+            half_norm[i] = 0.5f * norm * input_scale * input_scale;
+
+            for (size_t j = 0; j < projected.cols(); ++j)
+            {
+                projected(i, j) = projected(i, j) * input_scale - half_norm[i];
+                global_max = std::max(global_max, projected(i, j));
+            }
+        }
+
+        // Stabilize the exponent: a per-row shift cancels in the query normalizer,
+        // keys need one shared shift so their relative weights are preserved
+#pragma omp parallel for if (use_parallel)
+        for (size_t i = 0; i < projected.rows(); ++i)
+        {
+            float shift = global_max;
+            if (is_query)
+            {
+                shift = projected(i, 0);
+                for (size_t j = 1; j < projected.cols(); ++j)
+                {
+                    shift = std::max(shift, projected(i, j));
+                }
+            }
+
+            for (size_t j = 0; j < projected.cols(); ++j)
+            {
+                projected(i, j) = std::exp(projected(i, j) - shift) * output_scale;
+            }
+        }
+
+        return projected;
+    }
+
+    void MultiHeadAttention::collect_key_importance(const std::vector<std::vector<float>> &head_importance,
+                                                    size_t num_queries, std::vector<float> &key_importance) const
+    {
+        key_importance.assign(head_importance[0].size(), 0.0f);
+        for (const std::vector<float> &importance : head_importance)
+        {
+            for (size_t j = 0; j < importance.size(); ++j)
+            {
+                key_importance[j] += importance[j];
+            }
+        }
+
+        float scale = 1.0f / static_cast<float>(config_.num_heads * num_queries);
+        for (float &value : key_importance)
+        {
+            value *= scale;
+        }
+    }
+
+    Matrix MultiHeadAttention::project_sequence(const Matrix &projection, const Matrix &input, bool use_parallel) const
+    {
+        // projection[:, :n] * input; shorter inputs use the leading columns, which is
+        // equivalent to zero-padding them to seq_length
+        if (input.rows() > projection.cols())
+        {
+            throw std::invalid_argument("Input is longer than the Linformer projection");
+        }
+
+        Matrix result(projection.rows(), input.cols());
+
+#pragma omp parallel for if (use_parallel)
+        for (size_t r = 0; r < projection.rows(); ++r)
+        {
+            float *out_row = &result.data()[r * input.cols()];
+            for (size_t i = 0; i < input.rows(); ++i)
+            {
+                float p = projection(r, i);
+                const float *in_row = &input.data()[i * input.cols()];
+#pragma omp simd
+                for (size_t j = 0; j < input.cols(); ++j)
+                {
+                    out_row[j] += p * in_row[j];
+                }
+            }
+        }
+
+        return result;
+    }
+
+    float MultiHeadAttention::position_bias(size_t head, size_t query, size_t key) const
+    {
+        // Evaluated per score element so no seq x seq bias matrix is ever stored
+        switch (config_.position_bias)
+        {
+        case PositionBias::ALiBi:
+            return -alibi_slopes_[head] * static_cast<float>(query > key ? query - key : key - query);
+        case PositionBias::T5Relative:
+            return relative_bias_(relative_bucket_[key + config_.seq_length - 1 - query], head);
+        default:
+            return 0.0f;
+        }
+    }
+
     Matrix MultiHeadAttention::softmax(const Matrix &input, bool use_parallel) const
     {
         Matrix result(input.rows(), input.cols());
@@ -229,14 +642,45 @@ namespace MicroTransformer
         return result;
     }
 
-    void MultiHeadAttention::split_heads(const Matrix &input, std::vector<Matrix> &heads) const
+    void MultiHeadAttention::split_heads(const Matrix &input, std::vector<Matrix> &heads, bool rotate) const
     {
+        if (rotate && rotary_)
+        {
+            if (input.rows() > rotary_->max_positions())
+            {
+                throw std::invalid_argument("Input is longer than the rotary table");
+            }
+
+            // RoPE is applied while scattering into the head layout, so Q and K are
+            // not read and written a second time. Row i is position i; each pair
+            // (2p, 2p + 1) of a head is rotated by position * theta_p
+#pragma omp parallel for collapse(2) if (!omp_in_parallel())
+            for (size_t h = 0; h < config_.num_heads; ++h)
+            {
+                for (size_t i = 0; i < input.rows(); ++i)
+                {
+                    const float *cos_row = rotary_->cos_row(i);
+                    const float *sin_row = rotary_->sin_row(i);
+                    const float *source = &input.data()[i * input.cols() + h * head_dim_];
+                    float *target = &heads[h].data()[i * head_dim_];
+                    for (size_t p = 0; p < head_dim_ / 2; ++p)
+                    {
+                        float x0 = source[2 * p];
+                        float x1 = source[2 * p + 1];
+                        target[2 * p] = x0 * cos_row[p] - x1 * sin_row[p];
+                        target[2 * p + 1] = x0 * sin_row[p] + x1 * cos_row[p];
+                    }
+                }
+            }
+            return;
+        }
+
 // Parallelize over both attention heads and sequence positions using collapse(2)
 // This provides better parallel efficiency for large dimensions
 #pragma omp parallel for collapse(2) if (!omp_in_parallel())
         for (size_t h = 0; h < config_.num_heads; ++h)
         {
-            for (size_t i = 0; i < config_.seq_length; ++i)
+            for (size_t i = 0; i < input.rows(); ++i)
             {
                 for (size_t j = 0; j < head_dim_; ++j)
                 {
@@ -248,14 +692,15 @@ namespace MicroTransformer
 
     Matrix MultiHeadAttention::concat_heads(const std::vector<Matrix> &heads) const
     {
-        Matrix result(config_.seq_length, config_.embed_dim);
+        const size_t rows = heads[0].rows();
+        Matrix result(rows, config_.embed_dim);
 
 // Parallelize over both attention heads and sequence positions using collapse(2)
 // This provides better parallel efficiency for large dimensions
 #pragma omp parallel for collapse(2) if (!omp_in_parallel())
         for (size_t h = 0; h < config_.num_heads; ++h)
         {
-            for (size_t i = 0; i < config_.seq_length; ++i)
+            for (size_t i = 0; i < rows; ++i)
             {
                 for (size_t j = 0; j < head_dim_; ++j)
                 {
@@ -0,0 +1,261 @@
+#include "runtime.h"
+#include <algorithm>
+#include <exception>
+
+namespace MicroTransformer
+{
+
+    // Batching Queue Implementation
+    BatchingQueue::BatchingQueue(TransformerEncoder &encoder, const BatchingOptions &options)
+        : encoder_(encoder), options_(options)
+    {
+        if (options_.max_batch_size == 0)
+        {
+            options_.max_batch_size = 1;
+        }
+        worker_ = std::thread(&BatchingQueue::worker_loop, this);
+    }
+
+    BatchingQueue::~BatchingQueue()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        arrived_.notify_all();
+        worker_.join();
+    }
+
+    std::future<Matrix> BatchingQueue::submit(Matrix input, const RequestOptions &request_options)
+    {
+        // Hash on the caller's thread so the worker only compares
+        const size_t rows = input.rows();
+        const size_t level = static_cast<size_t>(request_options.priority);
+        Request request{std::move(input), {}, {}, Metrics::Clock::now(), request_options.deadline};
+        request.key = hash_matrix(request.input, 0);
+        std::future<Matrix> future = request.result.get_future();
+        requests_.fetch_add(1, std::memory_order_relaxed);
+
+        const char *rejection = nullptr;
+        std::vector<Request> displaced;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            // Deadline: this request waits for the window and every queued row of its
+            // class or higher, served at the measured rate
+            if (request.deadline != Metrics::Clock::time_point::max())
+            {
+                size_t rows_ahead = rows;
+                for (size_t p = 0; p <= level; ++p)
+                {
+                    rows_ahead += queued_tokens_[p];
+                }
+                auto service = std::chrono::duration<double>(seconds_per_token_.load() * static_cast<double>(rows_ahead));
+                if (request.submitted + options_.batching_window +
+                        std::chrono::duration_cast<Metrics::Clock::duration>(service) >
+                    request.deadline)
+                {
+                    rejection = "deadline cannot be met";
+                }
+            }
+
+            // Token budget: displace the newest lower-priority requests, but only when
+            // that actually makes room
+            if (!rejection && options_.token_budget > 0)
+            {
+                size_t total = 0, displaceable = 0;
+                for (size_t p = 0; p < NUM_PRIORITIES; ++p)
+                {
+                    total += queued_tokens_[p];
+                    displaceable += p > level ? queued_tokens_[p] : 0;
+                }
+
+                if (total - displaceable + rows > options_.token_budget)
+                {
+                    rejection = "token budget exhausted";
+                }
+                for (size_t p = NUM_PRIORITIES - 1; !rejection && p > level && total + rows > options_.token_budget; --p)
+                {
+                    while (!pending_[p].empty() && total + rows > options_.token_budget)
+                    {
+                        size_t victim_rows = pending_[p].back().input.rows();
+                        displaced.push_back(std::move(pending_[p].back()));
+                        pending_[p].pop_back();
+                        queued_tokens_[p] -= victim_rows;
+                        --queued_requests_;
+                        total -= victim_rows;
+                    }
+                }
+            }
+
+            if (!rejection)
+            {
+                pending_[level].push_back(std::move(request));
+                queued_tokens_[level] += rows;
+                ++queued_requests_;
+            }
+        }
+
+        if (rejection)
+        {
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            Metrics::increment(Counter::RejectedRequests);
+            request.result.set_exception(std::make_exception_ptr(AdmissionError(std::string("Request rejected: ") + rejection)));
+            return future;
+        }
+
+        shed(displaced, "displaced by higher-priority requests");
+        arrived_.notify_one();
+        return future;
+    }
+
+    BatchingStats BatchingQueue::stats() const
+    {
+        return {requests_.load(std::memory_order_relaxed),
+                forwards_.load(std::memory_order_relaxed),
+                coalesced_.load(std::memory_order_relaxed),
+                batches_.load(std::memory_order_relaxed),
+                rejected_.load(std::memory_order_relaxed),
+                shed_.load(std::memory_order_relaxed)};
+    }
+
+    void BatchingQueue::worker_loop()
+    {
+        std::vector<Request> batch;
+        std::vector<Request> expired;
+
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                arrived_.wait(lock, [&]
+                              { return stopping_ || queued_requests_ > 0; });
+                if (queued_requests_ == 0)
+                {
+                    return; // Stopping and drained
+                }
+
+                // The window opens with the first waiting request; a full batch or
+                // shutdown closes it early
+                auto window_end = Metrics::Clock::now() + options_.batching_window;
+                arrived_.wait_until(lock, window_end, [&]
+                                    { return stopping_ || queued_requests_ >= options_.max_batch_size; });
+
+                // Highest class first. Requests that can no longer finish by their
+                // deadline are dropped here rather than spending a forward on them
+                const auto now = Metrics::Clock::now();
+                const double seconds_per_token = seconds_per_token_.load();
+                for (size_t p = 0; p < NUM_PRIORITIES && batch.size() < options_.max_batch_size; ++p)
+                {
+                    while (!pending_[p].empty() && batch.size() < options_.max_batch_size)
+                    {
+                        Request request = std::move(pending_[p].front());
+                        pending_[p].pop_front();
+                        queued_tokens_[p] -= request.input.rows();
+                        --queued_requests_;
+
+                        auto service = std::chrono::duration<double>(seconds_per_token * static_cast<double>(request.input.rows()));
+                        if (request.deadline != Metrics::Clock::time_point::max() &&
+                            now + std::chrono::duration_cast<Metrics::Clock::duration>(service) > request.deadline)
+                        {
+                            expired.push_back(std::move(request));
+                        }
+                        else
+                        {
+                            batch.push_back(std::move(request));
+                        }
+                    }
+                }
+            }
+
+            shed(expired, "deadline cannot be met");
+            expired.clear();
+            if (!batch.empty())
+            {
+                run_batch(batch);
+                batch.clear();
+            }
+        }
+    }
+
+    void BatchingQueue::shed(std::vector<Request> &dropped, const char *reason)
+    {
+        for (Request &request : dropped)
+        {
+            shed_.fetch_add(1, std::memory_order_relaxed);
+            Metrics::increment(Counter::ShedRequests);
+            request.result.set_exception(std::make_exception_ptr(AdmissionError(std::string("Request shed: ") + reason)));
+        }
+    }
+
+    void BatchingQueue::run_batch(std::vector<Request> &batch)
+    {
+        // Group requests by input. Equal hashes are confirmed with an exact compare, so
+        // a collision yields two groups rather than a wrong answer
+        std::vector<std::vector<size_t>> groups;
+        std::unordered_map<Hash128, std::vector<size_t>, Hash128Hasher> groups_by_key;
+
+        for (size_t r = 0; r < batch.size(); ++r)
+        {
+            std::vector<size_t> &candidates = groups_by_key[batch[r].key];
+            bool placed = false;
+            for (size_t g : candidates)
+            {
+                if (same_matrix(batch[groups[g][0]].input, batch[r].input))
+                {
+                    groups[g].push_back(r);
+                    placed = true;
+                    break;
+                }
+            }
+            if (!placed)
+            {
+                candidates.push_back(groups.size());
+                groups.push_back({r});
+            }
+        }
+
+        batches_.fetch_add(1, std::memory_order_relaxed);
+        forwards_.fetch_add(groups.size(), std::memory_order_relaxed);
+        coalesced_.fetch_add(batch.size() - groups.size(), std::memory_order_relaxed);
+
+        Metrics::increment(Counter::CoalescedRequests, batch.size() - groups.size());
+        Metrics::observe(Histogram::BatchSize, static_cast<double>(batch.size()));
+        for (const Request &request : batch)
+        {
+            Metrics::observe_since(Histogram::QueueWaitSeconds, request.submitted);
+        }
+
+        for (const std::vector<size_t> &group : groups)
+        {
+            Matrix output(0, 0);
+            try
+            {
+                FlightRecorder::BatchScope scope(batch.size(), groups.size(), group.size());
+                auto start = Metrics::Clock::now();
+                output = encoder_.forward(batch[group[0]].input, options_.use_parallel);
+
+                // Only this thread writes the estimate; submitters just read it
+                double sample = std::chrono::duration<double>(Metrics::Clock::now() - start).count() /
+                                static_cast<double>(std::max<size_t>(1, batch[group[0]].input.rows()));
+                double previous = seconds_per_token_.load();
+                seconds_per_token_.store(previous == 0.0 ? sample : 0.8 * previous + 0.2 * sample);
+            }
+            catch (...)
+            {
+                for (size_t r : group)
+                {
+                    batch[r].result.set_exception(std::current_exception());
+                }
+                continue;
+            }
+
+            for (size_t k = 1; k < group.size(); ++k)
+            {
+                batch[group[k]].result.set_value(output);
+            }
+            batch[group[0]].result.set_value(std::move(output));
+        }
+    }
+
+} // namespace MicroTransformer
@@ -1,10 +1,15 @@
 #include "transformer.h"
+#include <algorithm>
 #include <chrono>
 #include <fstream>
 #include <iostream>
 #include <iomanip>
 #include <random>
+#include <bit>
+#include <climits>
 #include <cmath>
+#include <cstdint>
+#include <limits>
 #include <omp.h>
 
 namespace MicroTransformer
@@ -15,7 +20,8 @@ namespace MicroTransformer
         TransformerEncoder &encoder,
         const Matrix &input,
         bool use_parallel,
-        size_t num_runs)
+        size_t num_runs,
+        bool measure_cold)
     {
 
         BenchmarkResult result;
@@ -40,22 +46,27 @@ namespace MicroTransformer
 
         result.execution_time_ms = static_cast<double>(duration.count()) / (1000.0 * num_runs);
 
+        // Cold runs: only the forward itself is timed, not the flush before it
+        if (measure_cold)
+        {
+            double cold_seconds = 0.0;
+            for (size_t run = 0; run < num_runs; ++run)
+            {
+                Utils::flush_caches();
+                auto cold_start = std::chrono::high_resolution_clock::now();
+                final_output = encoder.forward(input, use_parallel);
+                cold_seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - cold_start).count();
+            }
+            result.cold_execution_time_ms = cold_seconds * 1000.0 / static_cast<double>(num_runs);
+        }
+
         // Verify numerical correctness if we have a reference (serial) implementation
         if (use_parallel)
         {
             Matrix serial_output = encoder.forward(input, false);
-            result.numerical_correctness = verify_numerical_correctness(serial_output, final_output);
-
-            // Calculate maximum deviation
-            result.max_deviation = 0.0;
-            for (size_t i = 0; i < serial_output.rows(); ++i)
-            {
-                for (size_t j = 0; j < serial_output.cols(); ++j)
-                {
-                    double deviation = std::abs(serial_output(i, j) - final_output(i, j));
-                    result.max_deviation = std::max(result.max_deviation, deviation);
-                }
-            }
+            result.comparison = compare_results(serial_output, final_output);
+            result.numerical_correctness = result.comparison.shapes_match && result.comparison.max_abs_error <= CORRECTNESS_TOLERANCE;
+            result.max_deviation = result.comparison.max_abs_error;
         }
         else
         {
@@ -70,7 +81,8 @@ namespace MicroTransformer
         const TransformerConfig &base_config,
         const std::vector<size_t> &thread_counts,
         const std::vector<size_t> &sequence_lengths,
-        size_t num_runs)
+        size_t num_runs,
+        bool measure_cold)
     {
 
         std::vector<BenchmarkResult> results;
@@ -90,11 +102,16 @@ namespace MicroTransformer
             {
                 omp_set_num_threads(1);
                 TransformerEncoder encoder(config);
-                serial_result = measure_execution(encoder, input, false, num_runs);
+                serial_result = measure_execution(encoder, input, false, num_runs, measure_cold);
                 results.push_back(serial_result);
 
                 std::cout << "  Serial: " << std::fixed << std::setprecision(3)
-                          << serial_result.execution_time_ms << " ms" << std::endl;
+                          << serial_result.execution_time_ms << " ms";
+                if (measure_cold)
+                {
+                    std::cout << " (cold: " << serial_result.cold_execution_time_ms << " ms)";
+                }
+                std::cout << std::endl;
             }
 
             // Test parallel implementations with different thread counts
@@ -105,7 +122,7 @@ namespace MicroTransformer
 
                 omp_set_num_threads(static_cast<int>(thread_count));
                 TransformerEncoder encoder(config);
-                BenchmarkResult parallel_result = measure_execution(encoder, input, true, num_runs);
+                BenchmarkResult parallel_result = measure_execution(encoder, input, true, num_runs, measure_cold);
                 results.push_back(parallel_result);
 
                 // Calculate speedup compared to serial result for this sequence length
@@ -113,9 +130,15 @@ namespace MicroTransformer
 
                 std::cout << "  " << thread_count << " threads: "
                           << std::fixed << std::setprecision(3) << parallel_result.execution_time_ms
-                          << " ms (speedup: " << std::setprecision(2) << speedup << "x, "
+                          << " ms (";
+                if (measure_cold)
+                {
+                    std::cout << "cold: " << parallel_result.cold_execution_time_ms << " ms, ";
+                }
+                std::cout << "speedup: " << std::setprecision(2) << speedup << "x, "
                           << "correctness: " << (parallel_result.numerical_correctness ? "PASS" : "FAIL")
-                          << ", max_dev: " << std::scientific << parallel_result.max_deviation << ")"
+                          << ", max_dev: " << std::scientific << parallel_result.max_deviation
+                          << ", max_ulp: " << parallel_result.comparison.max_ulp_distance << ")"
                           << std::endl;
             }
         }
@@ -123,31 +146,241 @@ namespace MicroTransformer
         return results;
     }
 
-    bool PerformanceBenchmark::verify_numerical_correctness(
-        const Matrix &serial_result,
-        const Matrix &parallel_result,
-        float tolerance)
+    float PerformanceBenchmark::calibrate_sparse_density_threshold(
+        const TransformerConfig &config,
+        size_t num_runs)
+    {
+        // Time the FFN up-projection shape with the dense and block-sparse kernels
+        Matrix input = Utils::generate_random_input(config.seq_length, config.embed_dim);
+        const std::vector<float> densities = {0.05f, 0.1f, 0.2f, 0.3f, 0.4f, 0.5f, 0.6f, 0.7f, 0.8f, 0.9f};
+
+        // The threshold is exclusive: halfway between the last density where sparse won and
+        // the first where it lost, or the last winner itself when the whole grid wins.
+        // Never extrapolated past the measured grid
+        float threshold = 0.0f;
+        float last_win = 0.0f;
+        for (float density : densities)
+        {
+            ProjectionWeight weight(config.embed_dim, config.ff_dim);
+            weight.dense().randomize();
+            weight.prune(1.0f - density, config.sparse_block_rows, config.sparse_block_cols, 1.1f);
+            const Matrix dense = weight.to_dense(); // The pruned weight only keeps its sparse form
+
+            Matrix warmup = input.multiply_blocked(dense);
+            auto start_time = std::chrono::high_resolution_clock::now();
+            for (size_t run = 0; run < num_runs; ++run)
+            {
+                warmup = input.multiply_blocked(dense);
+            }
+            auto dense_time = std::chrono::high_resolution_clock::now() - start_time;
+
+            warmup = input.multiply_sparse(*weight.sparse());
+            start_time = std::chrono::high_resolution_clock::now();
+            for (size_t run = 0; run < num_runs; ++run)
+            {
+                warmup = input.multiply_sparse(*weight.sparse());
+            }
+            auto sparse_time = std::chrono::high_resolution_clock::now() - start_time;
+
+            if (sparse_time >= dense_time)
+            {
+                threshold = last_win > 0.0f ? 0.5f * (last_win + density) : 0.0f;
+                break;
+            }
+            last_win = density;
+            threshold = density;
+        }
+
+        return threshold;
+    }
+
+    ThreadCostModel PerformanceBenchmark::calibrate_thread_model(size_t num_runs)
     {
+        ThreadCostModel model;
+        model.max_threads = static_cast<size_t>(omp_get_max_threads());
+
+        // Single-thread throughput of the blocked GEMM the projections use
+        {
+            const size_t n = 128;
+            const size_t gemm_runs = std::max<size_t>(1, num_runs / 20);
+            Utils::ScopedThreadCount single(1);
+            Matrix a = Utils::generate_random_input(n, n);
+            Matrix b = Utils::generate_random_input(n, n);
+            Matrix warmup = a.multiply_blocked(b);
+
+            auto start_time = std::chrono::high_resolution_clock::now();
+            for (size_t run = 0; run < gemm_runs; ++run)
+            {
+                warmup = a.multiply_blocked(b);
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+            model.seconds_per_flop = seconds / (static_cast<double>(gemm_runs) * 2.0 * n * n * n);
+        }
 
-        if (serial_result.rows() != parallel_result.rows() ||
-            serial_result.cols() != parallel_result.cols())
+        if (model.max_threads < 2)
         {
-            return false;
+            return model;
         }
 
-        for (size_t i = 0; i < serial_result.rows(); ++i)
+        // Cost of an empty parallel region at 2 and at max threads, fitted as a + b * t
+        // (each member touches a shared counter so the regions cannot be optimized away)
+        auto region_seconds = [&](int threads)
         {
-            for (size_t j = 0; j < serial_result.cols(); ++j)
+            size_t arrivals = 0;
+            auto run_region = [&]
             {
-                float diff = std::abs(serial_result(i, j) - parallel_result(i, j));
-                if (diff > tolerance)
+#pragma omp parallel num_threads(threads)
                 {
-                    return false;
+#pragma omp atomic
+                    ++arrivals;
                 }
+            };
+
+            run_region();
+            auto start_time = std::chrono::high_resolution_clock::now();
+            for (size_t run = 0; run < num_runs; ++run)
+            {
+                run_region();
             }
+            double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+            return arrivals > 0 ? seconds / static_cast<double>(num_runs) : 0.0;
+        };
+
+        double two = region_seconds(2);
+        double full = region_seconds(static_cast<int>(model.max_threads));
+        if (model.max_threads > 2)
+        {
+            model.per_thread_seconds = std::max(0.0, (full - two) / static_cast<double>(model.max_threads - 2));
         }
+        model.fork_join_seconds = std::max(0.0, two - 2.0 * model.per_thread_seconds);
 
-        return true;
+        return model;
+    }
+
+    std::shared_ptr<const ThreadCostModel> PerformanceBenchmark::shared_thread_model()
+    {
+        static const std::shared_ptr<const ThreadCostModel> model =
+            std::make_shared<const ThreadCostModel>(calibrate_thread_model());
+        return model;
+    }
+
+    size_t ThreadCostModel::threads_for(double flops) const
+    {
+        const double serial_seconds = flops * seconds_per_flop;
+        size_t best_threads = 1;
+        double best_seconds = serial_seconds;
+
+        for (size_t threads = 2; threads <= max_threads; ++threads)
+        {
+            double seconds = serial_seconds / static_cast<double>(threads) + fork_join_seconds +
+                             per_thread_seconds * static_cast<double>(threads);
+            if (seconds < best_seconds)
+            {
+                best_seconds = seconds;
+                best_threads = threads;
+            }
+        }
+
+        return best_threads;
+    }
+
+    ComparisonStats PerformanceBenchmark::compare_results(const Matrix &reference, const Matrix &result)
+    {
+        ComparisonStats stats;
+        if (reference.rows() != result.rows() || reference.cols() != result.cols())
+        {
+            stats.shapes_match = false;
+            stats.max_abs_error = std::numeric_limits<double>::infinity();
+            return stats;
+        }
+
+        const size_t rows = reference.rows();
+        const size_t cols = reference.cols();
+        double sum_squares = 0.0;
+
+#pragma omp parallel if (rows * cols > 1000 && !omp_in_parallel())
+        {
+            // Per-thread partials, merged once at the end; -1 marks a thread with no rows
+            ComparisonStats local;
+            local.max_abs_error = -1.0;
+            double local_squares = 0.0;
+
+#pragma omp for nowait
+            for (size_t i = 0; i < rows; ++i)
+            {
+                const float *expected = &reference.data()[i * cols];
+                const float *actual = &result.data()[i * cols];
+
+                float row_abs = 0.0f, row_rel = 0.0f;
+                int64_t row_ulp = 0;
+                double row_squares = 0.0;
+#pragma omp simd reduction(max : row_abs, row_rel, row_ulp) reduction(+ : row_squares)
+                for (size_t j = 0; j < cols; ++j)
+                {
+                    float diff = std::abs(actual[j] - expected[j]);
+                    diff = diff == diff ? diff : std::numeric_limits<float>::infinity();
+
+                    // Map the sign-magnitude bit patterns onto one monotonic integer line
+                    int32_t a = std::bit_cast<int32_t>(actual[j]);
+                    int32_t e = std::bit_cast<int32_t>(expected[j]);
+                    int64_t a_ordered = a < 0 ? int64_t{INT32_MIN} - a : a;
+                    int64_t e_ordered = e < 0 ? int64_t{INT32_MIN} - e : e;
+                    int64_t ulp = a_ordered > e_ordered ? a_ordered - e_ordered : e_ordered - a_ordered;
+
+                    row_abs = std::max(row_abs, diff);
+                    row_rel = std::max(row_rel, diff / std::max(std::abs(expected[j]), std::numeric_limits<float>::min()));
+                    row_ulp = std::max(row_ulp, ulp);
+                    row_squares += static_cast<double>(diff) * diff;
+                }
+
+                // Locating the worst column needs a second scan, only for rows that set a new maximum
+                if (row_abs > local.max_abs_error)
+                {
+                    local.max_abs_error = row_abs;
+                    local.worst_row = i;
+                    for (size_t j = 0; j < cols; ++j)
+                    {
+                        float diff = std::abs(actual[j] - expected[j]);
+                        if (!(diff < row_abs))
+                        {
+                            local.worst_col = j;
+                            break;
+                        }
+                    }
+                }
+                local.max_rel_error = std::max(local.max_rel_error, static_cast<double>(row_rel));
+                local.max_ulp_distance = std::max(local.max_ulp_distance, static_cast<uint64_t>(row_ulp));
+                local_squares += row_squares;
+            }
+
+#pragma omp critical(compare_results)
+            {
+                if (local.max_abs_error > stats.max_abs_error ||
+                    (local.max_abs_error >= 0.0 && local.max_abs_error == stats.max_abs_error &&
+                     local.worst_row < stats.worst_row))
+                {
+                    stats.max_abs_error = local.max_abs_error;
+                    stats.worst_row = local.worst_row;
+                    stats.worst_col = local.worst_col;
+                }
+                stats.max_rel_error = std::max(stats.max_rel_error, local.max_rel_error);
+                stats.max_ulp_distance = std::max(stats.max_ulp_distance, local.max_ulp_distance);
+                sum_squares += local_squares;
+            }
+        }
+
+        const size_t count = rows * cols;
+        stats.rms_error = count > 0 ? std::sqrt(sum_squares / static_cast<double>(count)) : 0.0;
+        return stats;
+    }
+
+    bool PerformanceBenchmark::verify_numerical_correctness(
+        const Matrix &serial_result,
+        const Matrix &parallel_result,
+        float tolerance)
+    {
+        ComparisonStats stats = compare_results(serial_result, parallel_result);
+        return stats.shapes_match && stats.max_abs_error <= tolerance;
     }
 
     void PerformanceBenchmark::save_results_to_csv(
@@ -163,7 +396,8 @@ namespace MicroTransformer
 
         // Write CSV header
         file << "seq_length,embed_dim,num_heads,ff_dim,num_layers,thread_count,"
-             << "implementation_type,execution_time_ms,numerical_correctness,max_deviation\n";
+             << "implementation_type,execution_time_ms,cold_execution_time_ms,numerical_correctness,max_deviation,"
+             << "max_rel_error,max_ulp_distance,rms_error\n";
 
         // Write data
         for (const auto &result : results)
@@ -176,8 +410,12 @@ namespace MicroTransformer
                  << result.thread_count << ","
                  << result.implementation_type << ","
                  << std::fixed << std::setprecision(6) << result.execution_time_ms << ","
+                 << result.cold_execution_time_ms << ","
                  << (result.numerical_correctness ? "true" : "false") << ","
-                 << std::scientific << result.max_deviation << "\n";
+                 << std::scientific << result.max_deviation << ","
+                 << result.comparison.max_rel_error << ","
+                 << result.comparison.max_ulp_distance << ","
+                 << result.comparison.rms_error << "\n";
         }
 
         file.close();
@@ -238,6 +476,40 @@ namespace MicroTransformer
             return std::chrono::duration<double>(duration).count();
         }
 
+        void flush_caches(size_t buffer_bytes)
+        {
+            // Kept between calls so the sweep never pays for page faults; one per calling
+            // thread, so concurrent benchmarks never resize or write a shared buffer
+            thread_local std::vector<unsigned char> buffer;
+            if (buffer.size() < buffer_bytes)
+            {
+                buffer.resize(buffer_bytes);
+            }
+
+            // Read-modify-write of one byte per 64-byte line; dirty lines also flush write-backs
+            const size_t lines = buffer_bytes / 64;
+            unsigned char *data = buffer.data();
+#pragma omp parallel for if (!omp_in_parallel())
+            for (size_t line = 0; line < lines; ++line)
+            {
+                data[line * 64] += 1;
+            }
+        }
+
+        ScopedThreadCount::ScopedThreadCount(int num_threads)
+            : previous_(omp_get_max_threads())
+        {
+            if (num_threads > 0)
+            {
+                omp_set_num_threads(num_threads);
+            }
+        }
+
+        ScopedThreadCount::~ScopedThreadCount()
+        {
+            omp_set_num_threads(previous_);
+        }
+
     } // namespace Utils
 
 } // namespace MicroTransformer
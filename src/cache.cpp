@@ -0,0 +1,241 @@
+#include "runtime.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace MicroTransformer
+{
+
+    namespace
+    {
+        inline uint64_t rotl64(uint64_t x, int r)
+        {
+            return (x << r) | (x >> (64 - r));
+        }
+
+        inline uint64_t fmix64(uint64_t k)
+        {
+            k ^= k >> 33;
+            k *= 0xff51afd7ed558ccdULL;
+            k ^= k >> 33;
+            k *= 0xc4ceb9fe1a85ec53ULL;
+            k ^= k >> 33;
+            return k;
+        }
+    }
+
+    Hash128 hash_bytes(const void *data, size_t size, uint64_t seed)
+    {
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        const size_t num_blocks = size / 16;
+        const uint64_t c1 = 0x87c37b91114253d5ULL;
+        const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+        uint64_t h1 = seed;
+        uint64_t h2 = seed;
+
+        for (size_t i = 0; i < num_blocks; ++i)
+        {
+            uint64_t k1, k2;
+            std::memcpy(&k1, bytes + i * 16, sizeof(k1));
+            std::memcpy(&k2, bytes + i * 16 + 8, sizeof(k2));
+
+            k1 *= c1;
+            k1 = rotl64(k1, 31);
+            k1 *= c2;
+            h1 ^= k1;
+            h1 = rotl64(h1, 27);
+            h1 += h2;
+            h1 = h1 * 5 + 0x52dce729;
+
+            k2 *= c2;
+            k2 = rotl64(k2, 33);
+            k2 *= c1;
+            h2 ^= k2;
+            h2 = rotl64(h2, 31);
+            h2 += h1;
+            h2 = h2 * 5 + 0x38495ab5;
+        }
+
+        // Tail: up to 15 remaining bytes, little-endian into k1 (bytes 0-7) and k2 (8-14)
+        const uint8_t *tail = bytes + num_blocks * 16;
+        uint64_t k1 = 0;
+        uint64_t k2 = 0;
+        size_t remaining = size & 15;
+        for (size_t i = remaining; i > 8; --i)
+        {
+            k2 ^= static_cast<uint64_t>(tail[i - 1]) << ((i - 9) * 8);
+        }
+        if (remaining > 8)
+        {
+            k2 *= c2;
+            k2 = rotl64(k2, 33);
+            k2 *= c1;
+            h2 ^= k2;
+        }
+        for (size_t i = std::min<size_t>(remaining, 8); i > 0; --i)
+        {
+            k1 ^= static_cast<uint64_t>(tail[i - 1]) << ((i - 1) * 8);
+        }
+        if (remaining > 0)
+        {
+            k1 *= c1;
+            k1 = rotl64(k1, 31);
+            k1 *= c2;
+            h1 ^= k1;
+        }
+
+        h1 ^= size;
+        h2 ^= size;
+        h1 += h2;
+        h2 += h1;
+        h1 = fmix64(h1);
+        h2 = fmix64(h2);
+        h1 += h2;
+        h2 += h1;
+
+        return {h1, h2};
+    }
+
+    Hash128 hash_matrix(const Matrix &matrix, uint64_t model_id)
+    {
+        // Fold the shape into the seed so equal bytes with different shapes differ
+        uint64_t shape_seed = fmix64(model_id ^ fmix64(matrix.rows() * 0x9e3779b97f4a7c15ULL + matrix.cols()));
+        return hash_bytes(matrix.data(), matrix.rows() * matrix.cols() * sizeof(float), shape_seed);
+    }
+
+    bool same_matrix(const Matrix &a, const Matrix &b)
+    {
+        return a.rows() == b.rows() && a.cols() == b.cols() &&
+               std::memcmp(a.data(), b.data(), a.rows() * a.cols() * sizeof(float)) == 0;
+    }
+
+    // Response Cache Implementation
+    ResponseCache::ResponseCache(size_t memory_budget_bytes, size_t num_shards)
+    {
+        if (num_shards == 0)
+        {
+            throw std::invalid_argument("ResponseCache needs at least one shard");
+        }
+
+        shard_budget_ = memory_budget_bytes / num_shards;
+        shards_.reserve(num_shards);
+        for (size_t i = 0; i < num_shards; ++i)
+        {
+            shards_.push_back(std::make_unique<Shard>());
+        }
+    }
+
+    Hash128 ResponseCache::make_key(uint64_t model_id, const Matrix &input, Pooling pooling)
+    {
+        return hash_matrix(input, model_id * 8 + static_cast<uint64_t>(pooling));
+    }
+
+    size_t ResponseCache::entry_bytes(const Matrix &output)
+    {
+        return output.rows() * output.cols() * sizeof(float) + sizeof(Entry) + 4 * sizeof(void *);
+    }
+
+    std::optional<Matrix> ResponseCache::lookup(uint64_t model_id, const Matrix &input, Pooling pooling)
+    {
+        Hash128 key = make_key(model_id, input, pooling);
+        Shard &shard = shard_for(key);
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.index.find(key);
+        if (found == shard.index.end())
+        {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            Metrics::increment(Counter::CacheMisses);
+            return std::nullopt;
+        }
+
+        shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        Metrics::increment(Counter::CacheHits);
+        return found->second->output;
+    }
+
+    void ResponseCache::insert(uint64_t model_id, const Matrix &input, const Matrix &output, Pooling pooling)
+    {
+        size_t bytes = entry_bytes(output);
+        if (bytes > shard_budget_)
+        {
+            return;
+        }
+
+        Hash128 key = make_key(model_id, input, pooling);
+        Shard &shard = shard_for(key);
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.index.find(key);
+        if (found != shard.index.end())
+        {
+            shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+            return;
+        }
+
+        while (!shard.lru.empty() && shard.bytes + bytes > shard_budget_)
+        {
+            const Entry &victim = shard.lru.back();
+            shard.bytes -= entry_bytes(victim.output);
+            shard.index.erase(victim.key);
+            shard.lru.pop_back();
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+            Metrics::increment(Counter::CacheEvictions);
+        }
+
+        shard.lru.push_front({key, output});
+        shard.index.emplace(key, shard.lru.begin());
+        shard.bytes += bytes;
+    }
+
+    Matrix ResponseCache::forward(TransformerEncoder &encoder, uint64_t model_id, const Matrix &input,
+                                  bool use_parallel)
+    {
+        return forward(encoder, model_id, input, Pooling::None, use_parallel);
+    }
+
+    Matrix ResponseCache::forward(TransformerEncoder &encoder, uint64_t model_id, const Matrix &input,
+                                  Pooling pooling, bool use_parallel)
+    {
+        if (std::optional<Matrix> cached = lookup(model_id, input, pooling))
+        {
+            return std::move(*cached);
+        }
+
+        // Computed outside any lock; concurrent misses on one key both compute it
+        Matrix output = pooling == Pooling::None ? encoder.forward(input, use_parallel)
+                                                 : encoder.forward(input, pooling, use_parallel);
+        insert(model_id, input, output, pooling);
+        return output;
+    }
+
+    CacheStats ResponseCache::stats() const
+    {
+        CacheStats result{hits_.load(std::memory_order_relaxed),
+                          misses_.load(std::memory_order_relaxed),
+                          evictions_.load(std::memory_order_relaxed), 0, 0};
+
+        for (const auto &shard : shards_)
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            result.entries += shard->index.size();
+            result.bytes += shard->bytes;
+        }
+
+        return result;
+    }
+
+    void ResponseCache::clear()
+    {
+        for (const auto &shard : shards_)
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->lru.clear();
+            shard->index.clear();
+            shard->bytes = 0;
+        }
+    }
+
+} // namespace MicroTransformer
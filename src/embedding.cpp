@@ -0,0 +1,291 @@
+#include "transformer.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <omp.h>
+
+namespace MicroTransformer
+{
+
+    namespace
+    {
+        // IEEE 754 binary16 conversions (round to nearest even)
+        uint16_t float_to_half(float value)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+
+            uint32_t sign = (bits >> 16) & 0x8000u;
+            uint32_t exponent = (bits >> 23) & 0xFFu;
+            uint32_t mantissa = bits & 0x7FFFFFu;
+
+            if (exponent == 0xFFu)
+            {
+                return static_cast<uint16_t>(sign | 0x7C00u | (mantissa ? 0x200u : 0u));
+            }
+
+            int half_exponent = static_cast<int>(exponent) - 127 + 15;
+            if (half_exponent >= 0x1F)
+            {
+                return static_cast<uint16_t>(sign | 0x7C00u);
+            }
+            if (half_exponent <= 0)
+            {
+                if (half_exponent < -10)
+                {
+                    return static_cast<uint16_t>(sign);
+                }
+                mantissa |= 0x800000u;
+                uint32_t shift = static_cast<uint32_t>(14 - half_exponent);
+                uint32_t half_mantissa = mantissa >> shift;
+                uint32_t remainder = mantissa & ((1u << shift) - 1u);
+                uint32_t halfway = 1u << (shift - 1u);
+                if (remainder > halfway || (remainder == halfway && (half_mantissa & 1u)))
+                {
+                    ++half_mantissa;
+                }
+                return static_cast<uint16_t>(sign | half_mantissa);
+            }
+
+            uint32_t half = sign | (static_cast<uint32_t>(half_exponent) << 10) | (mantissa >> 13);
+            uint32_t remainder = mantissa & 0x1FFFu;
+            if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u)))
+            {
+                ++half; // May carry into the exponent, which rounds up correctly
+            }
+            return static_cast<uint16_t>(half);
+        }
+
+        float half_to_float(uint16_t half)
+        {
+            uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+            uint32_t exponent = (half >> 10) & 0x1Fu;
+            uint32_t mantissa = half & 0x3FFu;
+            uint32_t bits;
+
+            if (exponent == 0)
+            {
+                if (mantissa == 0)
+                {
+                    bits = sign;
+                }
+                else
+                {
+                    // Subnormal: renormalize into a float exponent
+                    int e = -1;
+                    do
+                    {
+                        ++e;
+                        mantissa <<= 1;
+                    } while ((mantissa & 0x400u) == 0);
+                    bits = sign | (static_cast<uint32_t>(127 - 15 - e) << 23) | ((mantissa & 0x3FFu) << 13);
+                }
+            }
+            else if (exponent == 0x1F)
+            {
+                bits = sign | 0x7F800000u | (mantissa << 13);
+            }
+            else
+            {
+                bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+            }
+
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        inline void prefetch(const void *address)
+        {
+#if defined(__GNUC__)
+            __builtin_prefetch(address, 0, 0);
+#else
+            (void)address;
+#endif
+        }
+    }
+
+    // Token Embedding Implementation
+    TokenEmbedding::TokenEmbedding(const TransformerConfig &config)
+        : config_(config),
+          positions_(config.seq_length, config.embed_dim)
+    {
+        if (config.vocab_size == 0)
+        {
+            throw std::invalid_argument("vocab_size must be positive for token inputs");
+        }
+
+        Matrix table(config.vocab_size, config.embed_dim);
+        table.randomize(-0.1f, 0.1f);
+        set_table(table);
+
+        if (config.positional_encoding == PositionalEncoding::Sinusoidal)
+        {
+            // PE(pos, 2i) = sin(pos / 10000^(2i/d)), PE(pos, 2i+1) = cos(...)
+            for (size_t pos = 0; pos < config.seq_length; ++pos)
+            {
+                for (size_t i = 0; i < config.embed_dim; i += 2)
+                {
+                    double angle = static_cast<double>(pos) /
+                                   std::pow(10000.0, static_cast<double>(i) / static_cast<double>(config.embed_dim));
+                    positions_(pos, i) = static_cast<float>(std::sin(angle));
+                    if (i + 1 < config.embed_dim)
+                    {
+                        positions_(pos, i + 1) = static_cast<float>(std::cos(angle));
+                    }
+                }
+            }
+        }
+        else if (config.positional_encoding == PositionalEncoding::Learned)
+        {
+            positions_.randomize(-0.1f, 0.1f);
+        }
+    }
+
+    void TokenEmbedding::set_table(const Matrix &table)
+    {
+        if (table.rows() != config_.vocab_size || table.cols() != config_.embed_dim)
+        {
+            throw std::invalid_argument("Embedding table dimensions don't match configuration");
+        }
+
+        const size_t size = table.rows() * table.cols();
+        table_f32_.clear();
+        table_f16_.clear();
+        table_i8_.clear();
+        row_scales_.clear();
+
+        switch (config_.embedding_storage)
+        {
+        case EmbeddingStorage::Float32:
+            table_f32_.assign(table.data(), table.data() + size);
+            break;
+        case EmbeddingStorage::Float16:
+            table_f16_.resize(size);
+            for (size_t i = 0; i < size; ++i)
+            {
+                table_f16_[i] = float_to_half(table.data()[i]);
+            }
+            break;
+        case EmbeddingStorage::Int8:
+            table_i8_.resize(size);
+            row_scales_.resize(table.rows());
+            for (size_t r = 0; r < table.rows(); ++r)
+            {
+                float max_abs = 0.0f;
+                for (size_t j = 0; j < table.cols(); ++j)
+                {
+                    max_abs = std::max(max_abs, std::abs(table(r, j)));
+                }
+                float scale = max_abs > 0.0f ? max_abs / 127.0f : 1.0f;
+                row_scales_[r] = scale;
+                for (size_t j = 0; j < table.cols(); ++j)
+                {
+                    table_i8_[r * table.cols() + j] = static_cast<int8_t>(std::lround(table(r, j) / scale));
+                }
+            }
+            break;
+        }
+    }
+
+    void TokenEmbedding::set_positions(const Matrix &positions)
+    {
+        if (config_.positional_encoding != PositionalEncoding::Learned)
+        {
+            throw std::invalid_argument("Positional table can only be set for learned encodings");
+        }
+        if (positions.rows() != config_.seq_length || positions.cols() != config_.embed_dim)
+        {
+            throw std::invalid_argument("Positional table dimensions don't match configuration");
+        }
+
+        positions_ = positions;
+    }
+
+    void TokenEmbedding::embed(const std::vector<uint32_t> &token_ids, Matrix &output, bool use_parallel) const
+    {
+        const size_t dim = config_.embed_dim;
+        if (token_ids.size() > config_.seq_length || output.rows() < token_ids.size() || output.cols() != dim)
+        {
+            throw std::invalid_argument("Token count or output buffer doesn't match configuration");
+        }
+        for (uint32_t id : token_ids)
+        {
+            if (id >= config_.vocab_size)
+            {
+                throw std::out_of_range("Token id outside the vocabulary");
+            }
+        }
+
+        const bool add_positions = config_.positional_encoding != PositionalEncoding::None;
+
+#pragma omp parallel for if (use_parallel && token_ids.size() * dim > 1000)
+        for (size_t pos = 0; pos < token_ids.size(); ++pos)
+        {
+            // Gathered rows are scattered through the table, so request upcoming ones early
+            if (pos + PREFETCH_DISTANCE < token_ids.size())
+            {
+                size_t ahead = token_ids[pos + PREFETCH_DISTANCE];
+                switch (config_.embedding_storage)
+                {
+                case EmbeddingStorage::Float32:
+                    prefetch(&table_f32_[ahead * dim]);
+                    break;
+                case EmbeddingStorage::Float16:
+                    prefetch(&table_f16_[ahead * dim]);
+                    break;
+                case EmbeddingStorage::Int8:
+                    prefetch(&table_i8_[ahead * dim]);
+                    break;
+                }
+            }
+
+            const size_t row = token_ids[pos];
+            float *out = &output.data()[pos * dim];
+            const float *position = &positions_.data()[pos * dim];
+            const float position_scale = add_positions ? 1.0f : 0.0f;
+
+            switch (config_.embedding_storage)
+            {
+            case EmbeddingStorage::Float32:
+            {
+                const float *source = &table_f32_[row * dim];
+#pragma omp simd
+                for (size_t j = 0; j < dim; ++j)
+                {
+                    out[j] = source[j] + position_scale * position[j];
+                }
+                break;
+            }
+            case EmbeddingStorage::Float16:
+            {
+                const uint16_t *source = &table_f16_[row * dim];
+                for (size_t j = 0; j < dim; ++j)
+                {
+                    out[j] = half_to_float(source[j]) + position_scale * position[j];
+                }
+                break;
+            }
+            case EmbeddingStorage::Int8:
+            {
+                const int8_t *source = &table_i8_[row * dim];
+                const float scale = row_scales_[row];
+#pragma omp simd
+                for (size_t j = 0; j < dim; ++j)
+                {
+                    out[j] = static_cast<float>(source[j]) * scale + position_scale * position[j];
+                }
+                break;
+            }
+            }
+        }
+    }
+
+    size_t TokenEmbedding::table_bytes() const
+    {
+        return table_f32_.size() * sizeof(float) + table_f16_.size() * sizeof(uint16_t) +
+               table_i8_.size() * sizeof(int8_t) + row_scales_.size() * sizeof(float);
+    }
+
+} // namespace MicroTransformer
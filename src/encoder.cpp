@@ -1,14 +1,23 @@
 #include "transformer.h"
+#include "metrics.h"
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include <omp.h>
 
 namespace MicroTransformer
 {
 
     // Transformer Encoder Layer Implementation
-    TransformerEncoderLayer::TransformerEncoderLayer(const TransformerConfig &config)
+    TransformerEncoderLayer::TransformerEncoderLayer(const TransformerConfig &config,
+                                                     std::shared_ptr<const RotaryTable> rotary,
+                                                     bool initialize_weights)
         : config_(config),
-          attention_(std::make_unique<MultiHeadAttention>(config)),
-          ffn_(std::make_unique<FeedForwardNetwork>(config)),
+          attention_(std::make_unique<MultiHeadAttention>(config, std::move(rotary), initialize_weights)),
+          ffn_(config.num_experts == 0 ? std::make_unique<FeedForwardNetwork>(config, initialize_weights) : nullptr),
+          moe_(config.num_experts > 0 ? std::make_unique<MixtureOfExperts>(config) : nullptr),
           norm1_(std::make_unique<LayerNorm>(config)),
           norm2_(std::make_unique<LayerNorm>(config))
     {
@@ -26,48 +35,153 @@ namespace MicroTransformer
         }
     }
 
-    Matrix TransformerEncoderLayer::forward_serial(const Matrix &input)
+    Matrix TransformerEncoderLayer::forward_serial(const Matrix &input, std::vector<float> *key_importance)
     {
         // Multi-Head Self-Attention with residual connection
-        Matrix attention_output = attention_->forward_serial(input);
+        Matrix attention_output = Metrics::timed(Histogram::AttentionSeconds, [&]
+                                                 { return attention_->forward_serial(input, key_importance); });
         Matrix residual1 = input + attention_output;
-        Matrix norm1_output = norm1_->forward_serial(residual1);
+        Matrix norm1_output = Metrics::timed(Histogram::LayerNormSeconds, [&]
+                                             { return norm1_->forward_serial(residual1); });
 
         // Feed-Forward Network with residual connection
-        Matrix ffn_output = ffn_->forward_serial(norm1_output);
+        Matrix ffn_output = Metrics::timed(Histogram::FeedForwardSeconds, [&]
+                                           { return moe_ ? moe_->forward_serial(norm1_output) : ffn_->forward_serial(norm1_output); });
         Matrix residual2 = norm1_output + ffn_output;
-        Matrix norm2_output = norm2_->forward_serial(residual2);
+        Matrix norm2_output = Metrics::timed(Histogram::LayerNormSeconds, [&]
+                                             { return norm2_->forward_serial(residual2); });
 
         return norm2_output;
     }
 
-    Matrix TransformerEncoderLayer::forward_parallel(const Matrix &input)
+    Matrix TransformerEncoderLayer::forward_parallel(const Matrix &input, std::vector<float> *key_importance)
     {
+        const OpThreads teams = plan_threads(input.rows());
+
         // Multi-Head Self-Attention with residual connection
-        Matrix attention_output = attention_->forward_parallel(input);
+        Matrix attention_output = Metrics::timed(Histogram::AttentionSeconds, [&]
+                                                 {
+                                                     Utils::ScopedThreadCount team(teams.attention);
+                                                     return attention_->forward_parallel(input, key_importance);
+                                                 });
         Matrix residual1 = input + attention_output; // Matrix addition is already parallelized
-        Matrix norm1_output = norm1_->forward_parallel(residual1);
+        Matrix norm1_output = Metrics::timed(Histogram::LayerNormSeconds, [&]
+                                             {
+                                                 Utils::ScopedThreadCount team(teams.norm);
+                                                 return norm1_->forward_parallel(residual1);
+                                             });
 
         // Feed-Forward Network with residual connection
-        Matrix ffn_output = ffn_->forward_parallel(norm1_output);
+        Matrix ffn_output = Metrics::timed(Histogram::FeedForwardSeconds, [&]
+                                           {
+                                               Utils::ScopedThreadCount team(teams.feed_forward);
+                                               return moe_ ? moe_->forward_parallel(norm1_output) : ffn_->forward_parallel(norm1_output);
+                                           });
         Matrix residual2 = norm1_output + ffn_output; // Matrix addition is already parallelized
-        Matrix norm2_output = norm2_->forward_parallel(residual2);
+        Matrix norm2_output = Metrics::timed(Histogram::LayerNormSeconds, [&]
+                                             {
+                                                 Utils::ScopedThreadCount team(teams.norm);
+                                                 return norm2_->forward_parallel(residual2);
+                                             });
 
         return norm2_output;
     }
 
-    // Complete Transformer Encoder Implementation
-    TransformerEncoder::TransformerEncoder(const TransformerConfig &config)
-        : config_(config)
+    TransformerEncoderLayer::OpThreads TransformerEncoderLayer::plan_threads(size_t rows) const
     {
+        if (!thread_model_)
+        {
+            return {0, 0, 0};
+        }
 
-        // Create all encoder layers
-        layers_.reserve(config.num_layers);
-        for (size_t i = 0; i < config.num_layers; ++i)
+        // Q/K/V/O projections plus scores and weighted values; FFN up and down
+        // projections per routed expert; normalization is a few passes over the rows
+        const double s = static_cast<double>(rows);
+        const double e = static_cast<double>(config_.embed_dim);
+        const double f = static_cast<double>(config_.ff_dim);
+        const double experts = config_.num_experts > 0 ? static_cast<double>(config_.experts_per_token) : 1.0;
+        const size_t team = static_cast<size_t>(omp_get_max_threads());
+        auto threads = [&](double flops)
+        { return static_cast<int>(std::min(thread_model_->threads_for(flops), team)); };
+        return {threads(8.0 * s * e * e + 4.0 * s * s * e), threads(4.0 * s * e * f * experts), threads(8.0 * s * e)};
+    }
+
+    Matrix TransformerEncoderLayer::forward_pooled(const Matrix &input, Pooling pooling, bool use_parallel)
+    {
+        if (pooling == Pooling::None)
+        {
+            return forward(input, use_parallel);
+        }
+
+        // CLS only needs row 0 past the key/value projections; mean/max need every row
+        // but pool inside the final norm instead of materializing its output
+        const size_t rows = pooling == Pooling::CLS ? 1 : input.rows();
+
+        // Keys and values still cover every row; everything after attention sees `rows`
+        const OpThreads all_rows = use_parallel ? plan_threads(input.rows()) : OpThreads{0, 0, 0};
+        const OpThreads kept_rows = use_parallel ? plan_threads(rows) : OpThreads{0, 0, 0};
+
+        Matrix attention_output = Metrics::timed(Histogram::AttentionSeconds, [&]
+                                                 {
+                                                     Utils::ScopedThreadCount team(all_rows.attention);
+                                                     return attention_->forward_queries(input, rows, use_parallel);
+                                                 });
+        Matrix residual1 = (rows == input.rows() ? input : input.row_range(0, rows)) + attention_output;
+        Matrix norm1_output = Metrics::timed(Histogram::LayerNormSeconds, [&]
+                                             {
+                                                 Utils::ScopedThreadCount team(kept_rows.norm);
+                                                 return norm1_->forward(residual1, use_parallel);
+                                             });
+
+        Matrix ffn_output = Metrics::timed(Histogram::FeedForwardSeconds, [&]
+                                           {
+                                               Utils::ScopedThreadCount team(kept_rows.feed_forward);
+                                               return moe_ ? moe_->forward(norm1_output, use_parallel) : ffn_->forward(norm1_output, use_parallel);
+                                           });
+        Matrix residual2 = norm1_output + ffn_output;
+        return Metrics::timed(Histogram::LayerNormSeconds, [&]
+                              {
+                                  Utils::ScopedThreadCount team(kept_rows.norm);
+                                  return norm2_->forward_pooled(residual2, pooling, use_parallel);
+                              });
+    }
+
+    void TransformerEncoderLayer::prune_weights(float sparsity)
+    {
+        attention_->prune_weights(sparsity);
+        if (moe_)
+        {
+            moe_->prune_weights(sparsity);
+        }
+        else
         {
-            layers_.push_back(std::make_unique<TransformerEncoderLayer>(config));
+            ffn_->prune_weights(sparsity);
         }
+    }
+
+    void TransformerEncoderLayer::compress_low_rank(float error_budget)
+    {
+        attention_->compress_low_rank(error_budget);
+        if (moe_)
+        {
+            moe_->compress_low_rank(error_budget);
+        }
+        else
+        {
+            ffn_->compress_low_rank(error_budget);
+        }
+    }
+
+    size_t TransformerEncoderLayer::weight_bytes() const
+    {
+        return attention_->weight_bytes() + (moe_ ? moe_->weight_bytes() : ffn_->weight_bytes()) +
+               norm1_->weight_bytes() + norm2_->weight_bytes();
+    }
 
+    // Complete Transformer Encoder Implementation
+    TransformerEncoder::TransformerEncoder(const TransformerConfig &config)
+        : TransformerEncoder(config, true)
+    {
         std::cout << "Initialized Transformer Encoder with:" << std::endl;
         std::cout << "  - " << config.num_layers << " layers" << std::endl;
         std::cout << "  - " << config.num_heads << " attention heads" << std::endl;
@@ -76,6 +190,36 @@ namespace MicroTransformer
         std::cout << "  - " << config.ff_dim << " feed-forward dimensions" << std::endl;
     }
 
+    TransformerEncoder::TransformerEncoder(const TransformerConfig &config, bool initialize_weights)
+        : config_(config),
+          embedding_(config.vocab_size > 0 ? std::make_unique<TokenEmbedding>(config) : nullptr)
+    {
+        if (config.token_reduction == TokenReduction::Prune && config.attention_type != AttentionType::Softmax)
+        {
+            throw std::invalid_argument("Token pruning requires softmax attention scores");
+        }
+
+        if ((config.rotary_embeddings || config.position_bias != PositionBias::None) &&
+            config.token_reduction != TokenReduction::None)
+        {
+            throw std::invalid_argument("Position-dependent attention cannot be combined with token reduction");
+        }
+
+        // One rotary table serves every layer
+        std::shared_ptr<const RotaryTable> rotary;
+        if (config.rotary_embeddings && config.num_heads > 0)
+        {
+            rotary = std::make_shared<RotaryTable>(config.seq_length, config.embed_dim / config.num_heads, config.rope_theta);
+        }
+
+        // Create all encoder layers
+        layers_.reserve(config.num_layers);
+        for (size_t i = 0; i < config.num_layers; ++i)
+        {
+            layers_.push_back(std::make_unique<TransformerEncoderLayer>(config, rotary, initialize_weights));
+        }
+    }
+
     Matrix TransformerEncoder::forward(const Matrix &input, bool use_parallel)
     {
         if (use_parallel)
@@ -95,34 +239,427 @@ namespace MicroTransformer
             throw std::invalid_argument("Input dimensions don't match configuration");
         }
 
-        Matrix current_output = input;
+        return run_layers(input, false, nullptr);
+    }
 
-        // Pass through all encoder layers sequentially
-        for (size_t i = 0; i < layers_.size(); ++i)
+    Matrix TransformerEncoder::forward_parallel(const Matrix &input)
+    {
+        if (input.rows() != config_.seq_length || input.cols() != config_.embed_dim)
         {
-            current_output = layers_[i]->forward_serial(current_output);
+            throw std::invalid_argument("Input dimensions don't match configuration");
         }
 
-        return current_output;
+        return run_layers(input, true, nullptr);
     }
 
-    Matrix TransformerEncoder::forward_parallel(const Matrix &input)
+    std::vector<Matrix> TransformerEncoder::forward_batch(const std::vector<Matrix> &inputs)
+    {
+        for (const Matrix &input : inputs)
+        {
+            if (input.rows() != config_.seq_length || input.cols() != config_.embed_dim)
+            {
+                throw std::invalid_argument("Input dimensions don't match configuration");
+            }
+        }
+
+        // Every intermediate of a serial forward is a local of the calling thread, so the
+        // sequences share nothing but the read-only weights. Inner operators check
+        // omp_in_parallel() and stay single-threaded inside this region
+        std::vector<Matrix> outputs(inputs.size(), Matrix(0, 0));
+        std::exception_ptr error;
+
+#pragma omp parallel for schedule(dynamic) if (inputs.size() > 1 && !omp_in_parallel())
+        for (size_t i = 0; i < inputs.size(); ++i)
+        {
+            try
+            {
+                outputs[i] = run_layers(inputs[i], false, nullptr);
+            }
+            catch (...)
+            {
+#pragma omp critical(forward_batch_error)
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+            }
+        }
+
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+        return outputs;
+    }
+
+    Matrix TransformerEncoder::forward_tokens(const std::vector<uint32_t> &token_ids, bool use_parallel)
+    {
+        if (token_ids.size() != config_.seq_length)
+        {
+            throw std::invalid_argument("Token count doesn't match configuration");
+        }
+
+        Matrix input(config_.seq_length, config_.embed_dim);
+        embedding().embed(token_ids, input, use_parallel);
+        return run_layers(input, use_parallel, nullptr);
+    }
+
+    TokenEmbedding &TransformerEncoder::embedding()
+    {
+        if (!embedding_)
+        {
+            throw std::runtime_error("Encoder has no token embedding (vocab_size is 0)");
+        }
+        return *embedding_;
+    }
+
+    Matrix TransformerEncoder::forward(const Matrix &input, Pooling pooling, bool use_parallel)
+    {
+        if (input.rows() != config_.seq_length || input.cols() != config_.embed_dim)
+        {
+            throw std::invalid_argument("Input dimensions don't match configuration");
+        }
+
+        return run_layers(input, use_parallel, nullptr, nullptr, nullptr, pooling);
+    }
+
+    ReducedOutput TransformerEncoder::forward_reduced(const Matrix &input, bool use_parallel)
+    {
+        if (input.rows() != config_.seq_length || input.cols() != config_.embed_dim)
+        {
+            throw std::invalid_argument("Input dimensions don't match configuration");
+        }
+
+        std::vector<size_t> token_rows;
+        Matrix output = run_layers(input, use_parallel, &token_rows);
+        return {std::move(output), std::move(token_rows)};
+    }
+
+    EarlyExitOutput TransformerEncoder::forward_early_exit(const Matrix &input, const EarlyExitOptions &options,
+                                                           bool use_parallel)
     {
         if (input.rows() != config_.seq_length || input.cols() != config_.embed_dim)
         {
             throw std::invalid_argument("Input dimensions don't match configuration");
         }
 
-        Matrix current_output = input;
+        size_t layers_used = 0;
+        Matrix output = run_layers(input, use_parallel, nullptr, &options, &layers_used);
+        return {std::move(output), layers_used};
+    }
+
+    Matrix TransformerEncoder::run_layers(const Matrix &input, bool use_parallel, std::vector<size_t> *token_rows,
+                                          const EarlyExitOptions *early_exit, size_t *layers_used,
+                                          Pooling pooling)
+    {
+        Metrics::ScopedTimer forward_timer(Histogram::ForwardSeconds);
+        FlightRecorder::Trace trace(input.rows(), input.cols(), use_parallel ? omp_get_max_threads() : 1);
+        Metrics::increment(Counter::Requests);
+        Metrics::increment(Counter::Tokens, input.rows());
+
+        if (layers_.empty())
+        {
+            return input;
+        }
+
+        // Layer 0 reads the caller's buffer directly, so embedded inputs are never copied
+        Matrix current_output(0, 0);
+
+        if (token_rows)
+        {
+            token_rows->resize(input.rows());
+            for (size_t t = 0; t < input.rows(); ++t)
+            {
+                (*token_rows)[t] = t;
+            }
+        }
+        std::vector<float> token_sizes(input.rows(), 1.0f);
+        std::vector<float> key_importance; // Of the latest layer, for TokenReduction::Prune
+        std::vector<float> pooled;
+        if (early_exit)
+        {
+            pooled = mean_pool(input, use_parallel);
+        }
 
         // Pass through all encoder layers sequentially (layers can't be parallelized as they depend on each other)
         // But each layer's internal operations are parallelized
         for (size_t i = 0; i < layers_.size(); ++i)
         {
-            current_output = layers_[i]->forward_parallel(current_output);
+            const Matrix &layer_input = i == 0 ? input : current_output;
+            trace.set_layer(i);
+            if (pooling != Pooling::None && i + 1 == layers_.size())
+            {
+                return layers_[i]->forward_pooled(layer_input, pooling, use_parallel);
+            }
+
+            std::vector<float> *importance = config_.token_reduction == TokenReduction::Prune ? &key_importance : nullptr;
+            current_output = use_parallel ? layers_[i]->forward_parallel(layer_input, importance)
+                                          : layers_[i]->forward_serial(layer_input, importance);
+            if (layers_used)
+            {
+                *layers_used = i + 1;
+            }
+
+            // Early-exit probe: cosine between the pooled outputs of consecutive layers.
+            // Pooling keeps the probe O(rows * embed_dim) and independent of token reduction
+            if (early_exit)
+            {
+                std::vector<float> next_pooled = mean_pool(current_output, use_parallel);
+                float dot = 0.0f, norm_prev = 0.0f, norm_next = 0.0f;
+                for (size_t j = 0; j < next_pooled.size(); ++j)
+                {
+                    dot += pooled[j] * next_pooled[j];
+                    norm_prev += pooled[j] * pooled[j];
+                    norm_next += next_pooled[j] * next_pooled[j];
+                }
+                pooled = std::move(next_pooled);
+
+                float cosine = dot / (std::sqrt(norm_prev * norm_next) + 1e-12f);
+                if (i + 1 >= early_exit->min_layers && cosine >= early_exit->cosine_threshold)
+                {
+                    break;
+                }
+            }
+
+            if (config_.token_reduction == TokenReduction::None || i + 1 == layers_.size())
+            {
+                continue;
+            }
+
+            // Shrink the rows fed to deeper layers and remap where each input token lives
+            std::vector<size_t> new_row_of;
+            if (config_.token_reduction == TokenReduction::Prune)
+            {
+                current_output = prune_tokens(current_output, key_importance, new_row_of);
+            }
+            else
+            {
+                current_output = merge_tokens(current_output, token_sizes, new_row_of, use_parallel);
+            }
+
+            if (token_rows)
+            {
+                for (size_t &row : *token_rows)
+                {
+                    row = row == ReducedOutput::DROPPED_TOKEN ? row : new_row_of[row];
+                }
+            }
         }
 
         return current_output;
     }
 
+    std::vector<float> TransformerEncoder::mean_pool(const Matrix &rows, bool use_parallel)
+    {
+        std::vector<float> pooled(rows.cols(), 0.0f);
+
+#pragma omp parallel for if (use_parallel && rows.rows() * rows.cols() > 1000)
+        for (size_t j = 0; j < rows.cols(); ++j)
+        {
+            float sum = 0.0f;
+            for (size_t i = 0; i < rows.rows(); ++i)
+            {
+                sum += rows(i, j);
+            }
+            pooled[j] = sum / static_cast<float>(rows.rows());
+        }
+
+        return pooled;
+    }
+
+    Matrix TransformerEncoder::prune_tokens(const Matrix &rows, const std::vector<float> &importance,
+                                            std::vector<size_t> &new_row_of) const
+    {
+        const size_t first = config_.keep_first_token ? 1 : 0;
+        const size_t candidates = rows.rows() > first ? rows.rows() - first : 0;
+        const size_t removed = std::min(config_.tokens_reduced_per_layer, candidates > 0 ? candidates - 1 : 0);
+
+        // Drop the `removed` least-attended candidates; ties go to the later row
+        std::vector<size_t> order(candidates);
+        for (size_t c = 0; c < candidates; ++c)
+        {
+            order[c] = first + c;
+        }
+        std::partial_sort(order.begin(), order.begin() + removed, order.end(), [&](size_t a, size_t b)
+                          { return importance[a] < importance[b] || (importance[a] == importance[b] && a > b); });
+
+        new_row_of.assign(rows.rows(), 0);
+        for (size_t r = 0; r < removed; ++r)
+        {
+            new_row_of[order[r]] = ReducedOutput::DROPPED_TOKEN;
+        }
+
+        Matrix result(rows.rows() - removed, rows.cols());
+        size_t next = 0;
+        for (size_t i = 0; i < rows.rows(); ++i)
+        {
+            if (new_row_of[i] == ReducedOutput::DROPPED_TOKEN)
+            {
+                continue;
+            }
+            std::copy_n(&rows.data()[i * rows.cols()], rows.cols(), &result.data()[next * rows.cols()]);
+            new_row_of[i] = next++;
+        }
+
+        return result;
+    }
+
+    Matrix TransformerEncoder::merge_tokens(const Matrix &rows, std::vector<float> &token_sizes,
+                                            std::vector<size_t> &new_row_of, bool use_parallel) const
+    {
+        // Bipartite soft matching: even rows (set A) are merged into their most similar
+        // odd row (set B); the protected first row never leaves set A
+        const size_t n = rows.rows();
+        const size_t first = config_.keep_first_token ? 1 : 0;
+        const size_t num_a = (n + 1) / 2;
+        const size_t num_b = n / 2;
+        if (num_b == 0 || num_a <= first)
+        {
+            new_row_of.resize(n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                new_row_of[i] = i;
+            }
+            return rows;
+        }
+
+        // Cosine similarity between A and B rows as one GEMM on normalized rows
+        Matrix a_rows(num_a, rows.cols());
+        Matrix b_rows_t(rows.cols(), num_b);
+#pragma omp parallel for if (use_parallel)
+        for (size_t i = 0; i < n; ++i)
+        {
+            float norm = 0.0f;
+            for (size_t j = 0; j < rows.cols(); ++j)
+            {
+                norm += rows(i, j) * rows(i, j);
+            }
+            float inv = 1.0f / (std::sqrt(norm) + 1e-12f);
+            for (size_t j = 0; j < rows.cols(); ++j)
+            {
+                if (i % 2 == 0)
+                {
+                    a_rows(i / 2, j) = rows(i, j) * inv;
+                }
+                else
+                {
+                    b_rows_t(j, i / 2) = rows(i, j) * inv;
+                }
+            }
+        }
+        Matrix similarity = use_parallel ? a_rows.multiply_blocked(b_rows_t) : a_rows * b_rows_t;
+
+        std::vector<size_t> best_b(num_a, 0);
+        std::vector<float> best_score(num_a, 0.0f);
+        for (size_t a = 0; a < num_a; ++a)
+        {
+            for (size_t b = 1; b < num_b; ++b)
+            {
+                if (similarity(a, b) > similarity(a, best_b[a]))
+                {
+                    best_b[a] = b;
+                }
+            }
+            best_score[a] = similarity(a, best_b[a]);
+        }
+
+        // Merge the `merged` most similar A rows; at least one row must survive
+        const size_t merged = std::min(config_.tokens_reduced_per_layer, num_a - first);
+        std::vector<size_t> order(num_a - first);
+        for (size_t c = 0; c < order.size(); ++c)
+        {
+            order[c] = first + c;
+        }
+        std::partial_sort(order.begin(), order.begin() + merged, order.end(), [&](size_t x, size_t y)
+                          { return best_score[x] > best_score[y] || (best_score[x] == best_score[y] && x < y); });
+
+        // Size-weighted averages, so repeatedly merged tokens keep their full weight
+        Matrix sums(n, rows.cols());
+        std::vector<float> new_sizes(token_sizes);
+        for (size_t i = 0; i < n; ++i)
+        {
+            for (size_t j = 0; j < rows.cols(); ++j)
+            {
+                sums(i, j) = rows(i, j) * token_sizes[i];
+            }
+        }
+
+        std::vector<size_t> target(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            target[i] = i;
+        }
+        for (size_t m = 0; m < merged; ++m)
+        {
+            size_t source = 2 * order[m];
+            size_t destination = 2 * best_b[order[m]] + 1;
+            target[source] = destination;
+            new_sizes[destination] += token_sizes[source];
+            for (size_t j = 0; j < rows.cols(); ++j)
+            {
+                sums(destination, j) += sums(source, j);
+            }
+        }
+
+        Matrix result(n - merged, rows.cols());
+        std::vector<float> result_sizes;
+        result_sizes.reserve(n - merged);
+        new_row_of.assign(n, 0);
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (target[i] != i)
+            {
+                continue;
+            }
+            size_t row = result_sizes.size();
+            for (size_t j = 0; j < rows.cols(); ++j)
+            {
+                result(row, j) = sums(i, j) / new_sizes[i];
+            }
+            result_sizes.push_back(new_sizes[i]);
+            new_row_of[i] = row;
+        }
+        for (size_t i = 0; i < n; ++i)
+        {
+            new_row_of[i] = new_row_of[target[i]];
+        }
+
+        token_sizes = std::move(result_sizes);
+        return result;
+    }
+
+    void TransformerEncoder::prune_weights(float sparsity)
+    {
+        for (auto &layer : layers_)
+        {
+            layer->prune_weights(sparsity);
+        }
+    }
+
+    void TransformerEncoder::compress_low_rank(float error_budget)
+    {
+        for (auto &layer : layers_)
+        {
+            layer->compress_low_rank(error_budget);
+        }
+    }
+
+    size_t TransformerEncoder::weight_bytes() const
+    {
+        size_t total = embedding_ ? embedding_->table_bytes() : 0;
+        for (const auto &layer : layers_)
+        {
+            total += layer->weight_bytes();
+        }
+        return total;
+    }
+
+    void TransformerEncoder::set_thread_model(std::shared_ptr<const ThreadCostModel> model)
+    {
+        for (auto &layer : layers_)
+        {
+            layer->set_thread_model(model);
+        }
+    }
+
 } // namespace MicroTransformer
@@ -0,0 +1,121 @@
+#include "runtime.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace MicroTransformer
+{
+
+    // Hot-Swap Model Implementation
+    HotSwapModel::HotSwapModel(std::unique_ptr<TransformerEncoder> initial)
+        : current_(initial.release()), thread_model_(PerformanceBenchmark::shared_thread_model())
+    {
+        if (!current_.load())
+        {
+            throw std::invalid_argument("HotSwapModel needs an initial model");
+        }
+        current_.load()->set_thread_model(thread_model_);
+    }
+
+    HotSwapModel::~HotSwapModel()
+    {
+        delete current_.load();
+    }
+
+    size_t HotSwapModel::enter()
+    {
+        // Start from a per-thread slot so concurrent readers rarely contend
+        const size_t start = std::hash<std::thread::id>{}(std::this_thread::get_id()) % READER_SLOTS;
+
+        for (size_t attempt = 0;; ++attempt)
+        {
+            size_t slot = (start + attempt) % READER_SLOTS;
+            uint64_t expected = IDLE;
+            if (readers_[slot].epoch.compare_exchange_strong(expected, epoch_.load()))
+            {
+                return slot;
+            }
+            if (attempt % READER_SLOTS == READER_SLOTS - 1)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    Matrix HotSwapModel::forward(const Matrix &input, bool use_parallel)
+    {
+        // The slot is published before the model pointer is read: a writer that swaps
+        // after this point either sees the slot, or this reader sees the new model
+        size_t slot = enter();
+        Matrix output(0, 0);
+        try
+        {
+            output = current_.load()->forward(input, use_parallel);
+        }
+        catch (...)
+        {
+            leave(slot);
+            throw;
+        }
+        leave(slot);
+
+        if (retired_count_.load() > 0)
+        {
+            reclaim();
+        }
+        return output;
+    }
+
+    void HotSwapModel::publish(std::unique_ptr<TransformerEncoder> next)
+    {
+        if (!next)
+        {
+            throw std::invalid_argument("Cannot publish an empty model");
+        }
+        next->set_thread_model(thread_model_);
+
+        std::unique_ptr<TransformerEncoder> previous(current_.exchange(next.release()));
+        uint64_t retire_epoch = epoch_.fetch_add(1) + 1;
+        {
+            std::lock_guard<std::mutex> lock(retire_mutex_);
+            retired_.push_back({std::move(previous), retire_epoch});
+            retired_count_.store(retired_.size());
+        }
+
+        reclaim();
+    }
+
+    std::future<void> HotSwapModel::reload_async(const std::string &path,
+                                                 std::function<void(TransformerEncoder &)> prepare)
+    {
+        return std::async(std::launch::async, [this, path, prepare = std::move(prepare)]
+                          {
+                              auto next = std::make_unique<TransformerEncoder>(ModelWeights::load(path));
+                              if (prepare)
+                              {
+                                  prepare(*next);
+                              }
+                              publish(std::move(next)); });
+    }
+
+    void HotSwapModel::reclaim()
+    {
+        std::lock_guard<std::mutex> lock(retire_mutex_);
+        if (retired_.empty())
+        {
+            return;
+        }
+
+        uint64_t oldest_reader = IDLE;
+        for (const ReaderSlot &reader : readers_)
+        {
+            oldest_reader = std::min(oldest_reader, reader.epoch.load());
+        }
+
+        // A reader that entered before a version was retired may still be running it
+        retired_.erase(std::remove_if(retired_.begin(), retired_.end(), [&](const Retired &retired)
+                                      { return retired.epoch <= oldest_reader; }),
+                       retired_.end());
+        retired_count_.store(retired_.size());
+    }
+
+} // namespace MicroTransformer
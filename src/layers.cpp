@@ -1,26 +1,32 @@
 #include "transformer.h"
 #include <cmath>
 #include <algorithm>
+#include <bit>
+#include <cstdint>
 #include <omp.h>
 
 namespace MicroTransformer
 {
 
     // Feed-Forward Network Implementation
-    FeedForwardNetwork::FeedForwardNetwork(const TransformerConfig &config)
+    FeedForwardNetwork::FeedForwardNetwork(const TransformerConfig &config, bool initialize_weights)
         : config_(config),
           W1_(config.embed_dim, config.ff_dim),
-          b1_(1, config.ff_dim, 0.0f),
           W2_(config.ff_dim, config.embed_dim),
+          b1_(1, config.ff_dim, 0.0f),
           b2_(1, config.embed_dim, 0.0f)
     {
+        if (!initialize_weights)
+        {
+            return;
+        }
 
         // Initialize weights with Xavier/Glorot initialization
         float limit1 = std::sqrt(6.0f / (config.embed_dim + config.ff_dim));
         float limit2 = std::sqrt(6.0f / (config.ff_dim + config.embed_dim));
 
-        W1_.randomize(-limit1, limit1);
-        W2_.randomize(-limit2, limit2);
+        W1_.dense().randomize(-limit1, limit1);
+        W2_.dense().randomize(-limit2, limit2);
 
         // Initialize biases to small random values
         b1_.randomize(-0.01f, 0.01f);
@@ -42,7 +48,7 @@ namespace MicroTransformer
     Matrix FeedForwardNetwork::forward_serial(const Matrix &input)
     {
         // First linear transformation: input * W1 + b1
-        Matrix hidden = input * W1_;
+        Matrix hidden = W1_.apply_serial(input);
 
         // Add bias
         for (size_t i = 0; i < hidden.rows(); ++i)
@@ -57,7 +63,7 @@ namespace MicroTransformer
         Matrix activated = relu(hidden, false);
 
         // Second linear transformation: activated * W2 + b2
-        Matrix output = activated * W2_;
+        Matrix output = W2_.apply_serial(activated);
 
         // Add bias
         for (size_t i = 0; i < output.rows(); ++i)
@@ -74,26 +80,49 @@ namespace MicroTransformer
     Matrix FeedForwardNetwork::forward_parallel(const Matrix &input)
     {
         // First linear transformation: input * W1 + b1 with blocked multiplication
-        Matrix hidden = input.multiply_blocked(W1_);
+        Matrix hidden = W1_.apply_parallel(input);
 
-// Add bias in parallel
-#pragma omp parallel for collapse(2)
-        for (size_t i = 0; i < hidden.rows(); ++i)
+        // Fused bias + ReLU epilogue. While the activations are hot, record which
+        // hidden units are non-zero anywhere in each block of rows
+        const size_t num_row_blocks = (hidden.rows() + ACTIVATION_ROW_BLOCK - 1) / ACTIVATION_ROW_BLOCK;
+        const size_t mask_words = (hidden.cols() + 63) / 64;
+        std::vector<uint64_t> active_mask(num_row_blocks * mask_words, 0);
+        size_t zero_count = 0;
+
+#pragma omp parallel for reduction(+ : zero_count) if (!omp_in_parallel())
+        for (size_t block = 0; block < num_row_blocks; ++block)
         {
-            for (size_t j = 0; j < hidden.cols(); ++j)
+            size_t i_end = std::min((block + 1) * ACTIVATION_ROW_BLOCK, hidden.rows());
+            for (size_t i = block * ACTIVATION_ROW_BLOCK; i < i_end; ++i)
             {
-                hidden(i, j) += b1_(0, j);
+                for (size_t w = 0; w < mask_words; ++w)
+                {
+                    size_t j_end = std::min((w + 1) * 64, hidden.cols());
+                    uint64_t bits = 0;
+                    for (size_t j = w * 64; j < j_end; ++j)
+                    {
+                        float value = std::max(0.0f, hidden(i, j) + b1_(0, j));
+                        hidden(i, j) = value;
+                        bits |= static_cast<uint64_t>(value != 0.0f) << (j - w * 64);
+                    }
+                    zero_count += (j_end - w * 64) - static_cast<size_t>(std::popcount(bits));
+                    active_mask[block * mask_words + w] |= bits;
+                }
             }
         }
 
-        // Apply ReLU activation
-        Matrix activated = relu(hidden, true);
+        // Second linear transformation: activated * W2 + b2. Block-sparse W2 already
+        // skips zero activations; a dense W2 skips its inactive rows when enough are zero
+        float zero_fraction = static_cast<float>(zero_count) / static_cast<float>(hidden.rows() * hidden.cols());
+        if (!W2_.sparse() && !W2_.low_rank() && zero_fraction >= config_.activation_sparsity_threshold)
+        {
+            return masked_down_projection(hidden, active_mask);
+        }
 
-        // Second linear transformation: activated * W2 + b2 with blocked multiplication
-        Matrix output = activated.multiply_blocked(W2_);
+        Matrix output = W2_.apply_parallel(hidden);
 
 // Add bias in parallel
-#pragma omp parallel for collapse(2)
+#pragma omp parallel for collapse(2) if (!omp_in_parallel())
         for (size_t i = 0; i < output.rows(); ++i)
         {
             for (size_t j = 0; j < output.cols(); ++j)
@@ -105,6 +134,77 @@ namespace MicroTransformer
         return output;
     }
 
+    Matrix FeedForwardNetwork::masked_down_projection(const Matrix &activated, const std::vector<uint64_t> &active_mask) const
+    {
+        const Matrix &W2 = W2_.dense();
+        const size_t num_row_blocks = (activated.rows() + ACTIVATION_ROW_BLOCK - 1) / ACTIVATION_ROW_BLOCK;
+        const size_t mask_words = (activated.cols() + 63) / 64;
+        Matrix output(activated.rows(), W2.cols());
+
+#pragma omp parallel for schedule(dynamic) if (!omp_in_parallel())
+        for (size_t block = 0; block < num_row_blocks; ++block)
+        {
+            size_t i_begin = block * ACTIVATION_ROW_BLOCK;
+            size_t i_end = std::min(i_begin + ACTIVATION_ROW_BLOCK, activated.rows());
+
+            for (size_t i = i_begin; i < i_end; ++i)
+            {
+#pragma omp simd
+                for (size_t j = 0; j < W2.cols(); ++j)
+                {
+                    output(i, j) = b2_(0, j);
+                }
+            }
+
+            // Each active hidden unit streams its W2 row once for the whole row block
+            for (size_t w = 0; w < mask_words; ++w)
+            {
+                uint64_t bits = active_mask[block * mask_words + w];
+                while (bits != 0)
+                {
+                    size_t k = w * 64 + static_cast<size_t>(std::countr_zero(bits));
+                    bits &= bits - 1;
+
+                    const float *w2_row = &W2.data()[k * W2.cols()];
+                    for (size_t i = i_begin; i < i_end; ++i)
+                    {
+                        float a = activated(i, k);
+                        if (a == 0.0f)
+                        {
+                            continue;
+                        }
+
+                        float *out_row = &output.data()[i * W2.cols()];
+#pragma omp simd
+                        for (size_t j = 0; j < W2.cols(); ++j)
+                        {
+                            out_row[j] += a * w2_row[j];
+                        }
+                    }
+                }
+            }
+        }
+
+        return output;
+    }
+
+    void FeedForwardNetwork::prune_weights(float sparsity)
+    {
+        W1_.prune(sparsity, config_.sparse_block_rows, config_.sparse_block_cols, config_.sparse_density_threshold);
+        W2_.prune(sparsity, config_.sparse_block_rows, config_.sparse_block_cols, config_.sparse_density_threshold);
+    }
+
+    void FeedForwardNetwork::compress_low_rank(float error_budget)
+    {
+        W1_.compress_low_rank(error_budget);
+        W2_.compress_low_rank(error_budget);
+    }
+
+    size_t FeedForwardNetwork::weight_bytes() const
+    {
+        return W1_.bytes() + W2_.bytes() + b1_.bytes() + b2_.bytes();
+    }
+
     Matrix FeedForwardNetwork::relu(const Matrix &input, bool use_parallel) const
     {
         Matrix result(input.rows(), input.cols());
@@ -222,4 +322,69 @@ namespace MicroTransformer
         return result;
     }
 
+    Matrix LayerNorm::forward_pooled(const Matrix &input, Pooling pooling, bool use_parallel)
+    {
+        const size_t rows = pooling == Pooling::CLS ? 1 : input.rows();
+        const size_t cols = input.cols();
+        const int num_threads = use_parallel ? omp_get_max_threads() : 1;
+
+        // One partial accumulator per thread, reduced in thread order so the result
+        // only depends on the thread count
+        std::vector<float> partials(static_cast<size_t>(num_threads) * cols,
+                                    pooling == Pooling::Max ? -INFINITY : 0.0f);
+
+#pragma omp parallel num_threads(num_threads) if (use_parallel)
+        {
+            float *partial = &partials[static_cast<size_t>(omp_get_thread_num()) * cols];
+
+#pragma omp for
+            for (size_t i = 0; i < rows; ++i)
+            {
+                float mean = 0.0f;
+#pragma omp simd reduction(+ : mean)
+                for (size_t j = 0; j < cols; ++j)
+                {
+                    mean += input(i, j);
+                }
+                mean /= static_cast<float>(cols);
+
+                float variance = 0.0f;
+#pragma omp simd reduction(+ : variance)
+                for (size_t j = 0; j < cols; ++j)
+                {
+                    float diff = input(i, j) - mean;
+                    variance += diff * diff;
+                }
+                variance /= static_cast<float>(cols);
+
+                float std_dev = std::sqrt(variance + config_.epsilon);
+                for (size_t j = 0; j < cols; ++j)
+                {
+                    float normalized = gamma_(0, j) * ((input(i, j) - mean) / std_dev) + beta_(0, j);
+                    partial[j] = pooling == Pooling::Max ? std::max(partial[j], normalized) : partial[j] + normalized;
+                }
+            }
+        }
+
+        Matrix result(1, cols, pooling == Pooling::Max ? -INFINITY : 0.0f);
+        for (int t = 0; t < num_threads; ++t)
+        {
+            for (size_t j = 0; j < cols; ++j)
+            {
+                float value = partials[static_cast<size_t>(t) * cols + j];
+                result(0, j) = pooling == Pooling::Max ? std::max(result(0, j), value) : result(0, j) + value;
+            }
+        }
+
+        if (pooling == Pooling::Mean)
+        {
+            for (size_t j = 0; j < cols; ++j)
+            {
+                result(0, j) /= static_cast<float>(rows);
+            }
+        }
+
+        return result;
+    }
+
 } // namespace MicroTransformer
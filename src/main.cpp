@@ -1,9 +1,14 @@
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <string>
 #include <iomanip>
+#include <filesystem>
 #include <omp.h>
 #include "transformer.h"
+#include "runtime.h"
+#include "static_encoder.h"
 
 using namespace MicroTransformer;
 
@@ -39,8 +44,9 @@ void demonstrate_basic_functionality()
     std::cout << "  Number of Layers: " << config.num_layers << std::endl
               << std::endl;
 
-    // Create transformer
+    // Create transformer; its operators size their teams from the startup calibration
     TransformerEncoder encoder(config);
+    encoder.set_thread_model(PerformanceBenchmark::shared_thread_model());
 
     // Generate random input
     std::cout << "Generating random input..." << std::endl;
@@ -71,14 +77,15 @@ void demonstrate_basic_functionality()
 
     // Calculate speedup and verify correctness
     double speedup = serial_time / parallel_time;
-    bool correct = PerformanceBenchmark::verify_numerical_correctness(serial_output, parallel_output, 1e-4f);
+    bool correct = PerformanceBenchmark::verify_numerical_correctness(serial_output, parallel_output);
 
     std::cout << "Speedup: " << std::setprecision(2) << speedup << "x" << std::endl;
     std::cout << "Numerical correctness: " << (correct ? "PASS" : "FAIL") << std::endl;
     std::cout << std::endl;
 }
 
-void run_comprehensive_benchmark()
+// `isolated_executable` non-empty: run every point in a fresh process of that binary
+void run_comprehensive_benchmark(const std::string &isolated_executable)
 {
     std::cout << "=== Comprehensive Performance Benchmark ===" << std::endl;
 
@@ -106,9 +113,20 @@ void run_comprehensive_benchmark()
     std::cout << std::endl
               << std::endl;
 
-    // Run scalability test
-    std::vector<BenchmarkResult> results = PerformanceBenchmark::scalability_test(
-        base_config, thread_counts, sequence_lengths, 5);
+    // Run scalability test, with cold-cache latencies next to the warm ones
+    std::vector<BenchmarkResult> results;
+    if (isolated_executable.empty())
+    {
+        results = PerformanceBenchmark::scalability_test(
+            base_config, thread_counts, sequence_lengths, 5, true);
+    }
+    else
+    {
+        SweepOptions options;
+        options.measure_cold = true;
+        results = PerformanceBenchmark::isolated_scalability_test(
+            isolated_executable, base_config, thread_counts, sequence_lengths, 5, options);
+    }
 
     // Save results to CSV
     std::string filename = "benchmark_results_" +
@@ -173,25 +191,301 @@ void run_detailed_component_test()
     std::cout << "  Speedup: " << std::setprecision(2) << ffn_serial_time / ffn_parallel_time << "x" << std::endl;
     std::cout << "  Correctness: " << (PerformanceBenchmark::verify_numerical_correctness(ffn_serial, ffn_parallel) ? "PASS" : "FAIL") << std::endl
               << std::endl;
+
+    std::cout << "Testing Pruned Feed-Forward Network (90% block sparsity)..." << std::endl;
+    config.sparse_density_threshold = PerformanceBenchmark::calibrate_sparse_density_threshold(config);
+    std::cout << "  Calibrated density threshold: " << std::setprecision(2) << config.sparse_density_threshold << std::endl;
+    FeedForwardNetwork pruned_ffn(config);
+    pruned_ffn.prune_weights(0.9f);
+
+    Matrix pruned_serial = pruned_ffn.forward_serial(input);
+    start = std::chrono::high_resolution_clock::now();
+    Matrix pruned_parallel = pruned_ffn.forward_parallel(input);
+    end = std::chrono::high_resolution_clock::now();
+    auto pruned_parallel_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+
+    std::cout << "  Parallel: " << std::fixed << std::setprecision(3) << pruned_parallel_time << " ms" << std::endl;
+    std::cout << "  Speedup vs dense: " << std::setprecision(2) << ffn_parallel_time / pruned_parallel_time << "x" << std::endl;
+    std::cout << "  Correctness: " << (PerformanceBenchmark::verify_numerical_correctness(pruned_serial, pruned_parallel) ? "PASS" : "FAIL") << std::endl
+              << std::endl;
 }
 
-int main()
+// One short check per optional feature: serial vs parallel for every attention and
+// FFN variant, pooling, embedding storage, checkpoints and the serving runtime
+void run_feature_checks()
+{
+    std::cout << "=== Feature Checks ===" << std::endl;
+
+    TransformerConfig config;
+    config.seq_length = 32;
+    config.embed_dim = 64;
+    config.num_heads = 4;
+    config.ff_dim = 128;
+    config.num_layers = 2;
+
+    Matrix input = Utils::generate_random_input(config.seq_length, config.embed_dim);
+
+    auto check = [](const std::string &name, bool passed)
+    {
+        std::cout << "  " << std::left << std::setw(42) << name << std::right << (passed ? "PASS" : "FAIL") << std::endl;
+    };
+    auto matches = [](const Matrix &expected, const Matrix &actual, float tolerance = PerformanceBenchmark::CORRECTNESS_TOLERANCE)
+    {
+        return PerformanceBenchmark::verify_numerical_correctness(expected, actual, tolerance);
+    };
+
+    // Attention variants
+    auto check_attention = [&](const std::string &name, auto &&adjust)
+    {
+        TransformerConfig variant = config;
+        adjust(variant);
+        MultiHeadAttention attention(variant);
+        check(name, matches(attention.forward_serial(input), attention.forward_parallel(input)));
+    };
+    check_attention("Linear attention (elu+1)", [](TransformerConfig &c)
+                    { c.attention_type = AttentionType::Linear; });
+    check_attention("Linear attention (random features)", [](TransformerConfig &c)
+                    {
+                        c.attention_type = AttentionType::Linear;
+                        c.feature_map = FeatureMap::RandomFeatures;
+                        c.num_random_features = 32;
+                    });
+    check_attention("Linformer attention", [](TransformerConfig &c)
+                    {
+                        c.attention_type = AttentionType::Linformer;
+                        c.linformer_rank = 8;
+                    });
+    check_attention("Rotary embeddings", [](TransformerConfig &c)
+                    { c.rotary_embeddings = true; });
+    check_attention("ALiBi position bias", [](TransformerConfig &c)
+                    { c.position_bias = PositionBias::ALiBi; });
+    check_attention("T5 relative position bias", [](TransformerConfig &c)
+                    { c.position_bias = PositionBias::T5Relative; });
+
+    // Feed-forward variants
+    {
+        TransformerConfig variant = config;
+        variant.num_experts = 4;
+        variant.experts_per_token = 2;
+        MixtureOfExperts moe(variant);
+        check("Mixture of experts", matches(moe.forward_serial(input), moe.forward_parallel(input)));
+    }
+    {
+        FeedForwardNetwork ffn(config);
+        size_t dense_bytes = ffn.weight_bytes();
+        ffn.compress_low_rank(0.5f);
+        check("Low-rank FFN", ffn.weight_bytes() < dense_bytes &&
+                                  matches(ffn.forward_serial(input), ffn.forward_parallel(input)));
+    }
+
+    // Encoder-level features share one set of weights; encoders built from
+    // ModelWeights differ only in the config fields that do not change shapes
+    TransformerEncoder encoder(config);
+    const ModelWeights weights = encoder.export_weights();
+    const Matrix reference = encoder.forward(input, false);
+
+    for (TokenReduction reduction : {TokenReduction::Merge, TokenReduction::Prune})
+    {
+        ModelWeights reduced = weights;
+        reduced.config.token_reduction = reduction;
+        reduced.config.tokens_reduced_per_layer = 4;
+        TransformerEncoder reducer(reduced);
+        Matrix serial = reducer.forward(input, false);
+        check(reduction == TokenReduction::Merge ? "Token merging" : "Token pruning",
+              serial.rows() == config.seq_length - 4 * (config.num_layers - 1) &&
+                  matches(serial, reducer.forward(input, true)));
+    }
+
+    {
+        Matrix mean(1, config.embed_dim, 0.0f);
+        for (size_t i = 0; i < reference.rows(); ++i)
+        {
+            for (size_t j = 0; j < reference.cols(); ++j)
+            {
+                mean(0, j) += reference(i, j) / static_cast<float>(reference.rows());
+            }
+        }
+        check("Mean pooling vs full forward", matches(mean, encoder.forward(input, Pooling::Mean, true)));
+        check("CLS pooling vs full forward", matches(reference.row_range(0, 1), encoder.forward(input, Pooling::CLS, true)));
+    }
+
+    // Reduced-precision embedding tables against the float32 table
+    {
+        TransformerConfig embedding_config = config;
+        embedding_config.vocab_size = 100;
+        Matrix table = Utils::generate_random_input(embedding_config.vocab_size, config.embed_dim);
+        std::vector<uint32_t> tokens(config.seq_length);
+        for (size_t t = 0; t < tokens.size(); ++t)
+        {
+            tokens[t] = static_cast<uint32_t>((t * 37) % embedding_config.vocab_size);
+        }
+
+        auto embed = [&](EmbeddingStorage storage, bool use_parallel)
+        {
+            embedding_config.embedding_storage = storage;
+            TokenEmbedding embedding(embedding_config);
+            embedding.set_table(table);
+            Matrix output(tokens.size(), config.embed_dim);
+            embedding.embed(tokens, output, use_parallel);
+            return output;
+        };
+        Matrix exact = embed(EmbeddingStorage::Float32, false);
+        check("Float16 embedding table", matches(exact, embed(EmbeddingStorage::Float16, true), 1e-3f));
+        check("Int8 embedding table", matches(exact, embed(EmbeddingStorage::Int8, true), 1e-2f));
+    }
+
+    // Checkpoints reproduce the model bit for bit
+    const std::string path = (std::filesystem::temp_directory_path() / "micro_transformer_features.ckpt").string();
+    weights.save(path);
+    check("Checkpoint round trip", matches(reference, TransformerEncoder(ModelWeights::load(path)).forward(input, false), 0.0f));
+
+    // Serving runtime
+    {
+        ResponseCache cache(size_t{1} << 20);
+        Matrix miss = cache.forward(encoder, 1, input, false);
+        Matrix hit = cache.forward(encoder, 1, input, false);
+        CacheStats stats = cache.stats();
+        check("Response cache hit equals miss", stats.hits == 1 && stats.misses == 1 && same_matrix(miss, hit));
+    }
+    {
+        BatchingOptions options;
+        options.batching_window = std::chrono::milliseconds(50);
+        options.use_parallel = false;
+        BatchingQueue queue(encoder, options);
+        std::vector<std::future<Matrix>> results;
+        for (size_t r = 0; r < 8; ++r)
+        {
+            results.push_back(queue.submit(input));
+        }
+        bool identical = true;
+        for (std::future<Matrix> &result : results)
+        {
+            identical = identical && same_matrix(reference, result.get());
+        }
+        check("Batching coalesces 8 identical requests", identical && queue.stats().forwards == 1);
+    }
+    {
+        ModelRegistry registry([&](const std::string &)
+                               { return std::make_unique<TransformerEncoder>(weights); },
+                               size_t{64} << 20);
+        Matrix first = registry.forward("model", input, false);
+        Matrix second = registry.forward("model", input, false);
+        RegistryStats stats = registry.stats();
+        check("Model registry loads once", stats.loads == 1 && stats.hits >= 1 &&
+                                               same_matrix(reference, first) && same_matrix(reference, second));
+    }
+    {
+        HotSwapModel model(std::make_unique<TransformerEncoder>(weights));
+        bool before = same_matrix(reference, model.forward(input, false));
+
+        ModelWeights next = weights;
+        for (LayerWeights &layer : next.layers)
+        {
+            for (size_t j = 0; j < layer.norm2_gamma.cols(); ++j)
+            {
+                layer.norm2_gamma(0, j) *= 2.0f;
+            }
+        }
+        next.save(path);
+        model.reload_async(path).get();
+        Matrix expected = TransformerEncoder(next).forward(input, false);
+        check("Hot swap serves the reloaded model", before && model.version() == 1 &&
+                                                        same_matrix(expected, model.forward(input, false)));
+    }
+    std::filesystem::remove(path);
+
+    std::cout << std::endl;
+}
+
+void run_static_encoder_test()
+{
+    std::cout << "=== Fixed-Shape Static Encoder ===" << std::endl;
+
+    TransformerConfig config;
+    config.seq_length = 32;
+    config.embed_dim = 64;
+    config.num_heads = 4;
+    config.ff_dim = 128;
+    config.num_layers = 2;
+
+    // Both encoders read the same checkpoint file, so the weight format is covered too
+    const std::string path = (std::filesystem::temp_directory_path() / "micro_transformer_static.ckpt").string();
+    TransformerEncoder(config).export_weights().save(path);
+    ModelWeights weights = ModelWeights::load(path);
+    std::filesystem::remove(path);
+
+    TransformerEncoder dynamic_encoder(weights);
+    using StaticEncoder = StaticTransformerEncoder<32, 64, 4, 128, 2>;
+    auto static_encoder = std::make_unique<StaticEncoder>(weights); // Too large for the stack
+
+    Matrix input = Utils::generate_random_input(config.seq_length, config.embed_dim);
+    StaticEncoder::Sequence static_input, static_output;
+    std::copy_n(input.data(), static_input.size(), static_input.begin());
+
+    auto start = std::chrono::high_resolution_clock::now();
+    static_encoder->forward(static_input, static_output);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto static_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+
+    Matrix dynamic_output = dynamic_encoder.forward_serial(input);
+    Matrix static_result(config.seq_length, config.embed_dim);
+    std::copy_n(static_output.begin(), static_output.size(), static_result.data());
+
+    std::cout << "  Static forward: " << std::fixed << std::setprecision(3) << static_time << " ms" << std::endl;
+    std::cout << "  Correctness vs dynamic: " << (PerformanceBenchmark::verify_numerical_correctness(dynamic_output, static_result) ? "PASS" : "FAIL") << std::endl
+              << std::endl;
+}
+
+// Absolute path of this binary for re-exec; execve does not search PATH, so a bare argv[0] fails
+std::string current_executable(const char *argv0)
+{
+    std::error_code error;
+    std::filesystem::path self = std::filesystem::read_symlink("/proc/self/exe", error);
+    if (!error)
+    {
+        return self.string();
+    }
+    return std::filesystem::canonical(argv0).string();
+}
+
+int main(int argc, char **argv)
 {
     // Configure OpenMP to avoid nested parallelism issues
     omp_set_max_active_levels(1);
 
+    // Child process of an isolated sweep: measure one point and exit
+    if (argc > 1 && std::string(argv[1]) == "--sweep-point")
+    {
+        return PerformanceBenchmark::run_sweep_point(argc, argv);
+    }
+    const bool isolated = argc > 1 && std::string(argv[1]) == "--isolated";
+
     print_header();
 
     try
     {
+        // Calibrate the per-operator thread cost model once; every demo encoder shares it
+        std::shared_ptr<const ThreadCostModel> thread_model = PerformanceBenchmark::shared_thread_model();
+        std::cout << "Thread cost model: " << std::fixed << std::setprecision(2)
+                  << 1e-9 / thread_model->seconds_per_flop << " GFLOP/s per thread, "
+                  << thread_model->fork_join_seconds * 1e6 << " us fork/join + "
+                  << thread_model->per_thread_seconds * 1e6 << " us per thread" << std::endl
+                  << std::endl;
+
         // Demonstrate basic functionality
         demonstrate_basic_functionality();
 
         // Run detailed component tests
         run_detailed_component_test();
 
+        // One check per optional feature
+        run_feature_checks();
+
+        // Check the header-only static encoder against the dynamic one
+        run_static_encoder_test();
+
         // Run comprehensive benchmark
-        run_comprehensive_benchmark();
+        run_comprehensive_benchmark(isolated ? current_executable(argv[0]) : "");
 
         std::cout << "================================================================" << std::endl;
         std::cout << "           All tests completed successfully!                    " << std::endl;
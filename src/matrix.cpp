@@ -1,4 +1,5 @@
 #include "transformer.h"
+#include "metrics.h"
 #include <random>
 #include <algorithm>
 #include <stdexcept>
@@ -8,20 +9,35 @@
 namespace MicroTransformer
 {
 
+    namespace
+    {
+        inline void count_allocation(size_t elements)
+        {
+            if (elements > 0)
+            {
+                Metrics::increment(Counter::Allocations);
+                Metrics::increment(Counter::AllocatedBytes, elements * sizeof(float));
+            }
+        }
+    }
+
     // Matrix Implementation
     Matrix::Matrix(size_t rows, size_t cols)
         : rows_(rows), cols_(cols), data_(rows * cols, 0.0f)
     {
+        count_allocation(data_.size());
     }
 
     Matrix::Matrix(size_t rows, size_t cols, float value)
         : rows_(rows), cols_(cols), data_(rows * cols, value)
     {
+        count_allocation(data_.size());
     }
 
     Matrix::Matrix(const Matrix &other)
         : rows_(other.rows_), cols_(other.cols_), data_(other.data_)
     {
+        count_allocation(data_.size());
     }
 
     Matrix &Matrix::operator=(const Matrix &other)
@@ -30,7 +46,14 @@ namespace MicroTransformer
         {
             rows_ = other.rows_;
             cols_ = other.cols_;
+
+            // The vector reuses its buffer when it is large enough; count only real reallocations
+            const float *previous = data_.data();
             data_ = other.data_;
+            if (data_.data() != previous)
+            {
+                count_allocation(data_.size());
+            }
         }
         return *this;
     }
@@ -76,7 +99,7 @@ namespace MicroTransformer
 
         // Simple matrix multiplication - same for both serial and parallel
         // Parallelization decisions are made at higher level (forward_serial vs forward_parallel)
-#pragma omp parallel for collapse(2) if (rows_ * other.cols_ * cols_ > 1000)
+#pragma omp parallel for collapse(2) if (rows_ * other.cols_ * cols_ > 1000 && !omp_in_parallel())
         for (size_t i = 0; i < rows_; ++i)
         {
             for (size_t j = 0; j < other.cols_; ++j)
@@ -159,7 +182,7 @@ namespace MicroTransformer
 
         Matrix result(rows_, cols_);
 
-#pragma omp parallel for if (rows_ * cols_ > 1000)
+#pragma omp parallel for if (rows_ * cols_ > 1000 && !omp_in_parallel())
         for (size_t i = 0; i < data_.size(); ++i)
         {
             result.data_[i] = data_[i] + other.data_[i];
@@ -172,7 +195,7 @@ namespace MicroTransformer
     {
         Matrix result(cols_, rows_);
 
-#pragma omp parallel for collapse(2) if (rows_ * cols_ > 1000)
+#pragma omp parallel for collapse(2) if (rows_ * cols_ > 1000 && !omp_in_parallel())
         for (size_t i = 0; i < rows_; ++i)
         {
             for (size_t j = 0; j < cols_; ++j)
@@ -184,6 +207,18 @@ namespace MicroTransformer
         return result;
     }
 
+    Matrix Matrix::row_range(size_t begin, size_t end) const
+    {
+        if (begin > end || end > rows_)
+        {
+            throw std::invalid_argument("Row range out of bounds");
+        }
+
+        Matrix result(end - begin, cols_);
+        std::copy(data_.begin() + begin * cols_, data_.begin() + end * cols_, result.data_.begin());
+        return result;
+    }
+
     void Matrix::randomize(float min, float max)
     {
         std::random_device rd;
@@ -206,7 +241,7 @@ namespace MicroTransformer
 
     void Matrix::zero()
     {
-#pragma omp parallel for if (data_.size() > 1000)
+#pragma omp parallel for if (data_.size() > 1000 && !omp_in_parallel())
         for (size_t i = 0; i < data_.size(); ++i)
         {
             data_[i] = 0.0f;
@@ -0,0 +1,700 @@
+#include "metrics.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace MicroTransformer
+{
+
+    namespace
+    {
+        constexpr size_t NUM_COUNTERS = static_cast<size_t>(Counter::Count);
+        constexpr size_t NUM_HISTOGRAMS = static_cast<size_t>(Histogram::Count);
+        constexpr size_t MAX_BUCKETS = 16;
+
+        const double LATENCY_BOUNDS[] = {1e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3, 5e-3,
+                                         1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1.0, 5.0};
+        const double BATCH_BOUNDS[] = {1, 2, 4, 8, 16, 32, 64, 128};
+
+        struct CounterSpec
+        {
+            const char *name;
+            const char *help;
+        };
+
+        const CounterSpec COUNTER_SPECS[NUM_COUNTERS] = {
+            {"micro_transformer_requests_total", "Encoder forward passes started"},
+            {"micro_transformer_tokens_total", "Input rows across encoder forward passes"},
+            {"micro_transformer_coalesced_requests_total", "Requests answered by an identical request's forward"},
+            {"micro_transformer_rejected_requests_total", "Requests refused by queue admission control"},
+            {"micro_transformer_shed_requests_total", "Queued requests dropped for priority or deadline"},
+            {"micro_transformer_cache_hits_total", "Response cache hits"},
+            {"micro_transformer_cache_misses_total", "Response cache misses"},
+            {"micro_transformer_cache_evictions_total", "Response cache evictions"},
+            {"micro_transformer_model_loads_total", "Models loaded by the registry"},
+            {"micro_transformer_model_evictions_total", "Models evicted by the registry"},
+            {"micro_transformer_matrix_allocations_total", "Matrix buffers allocated"},
+            {"micro_transformer_matrix_allocated_bytes_total", "Bytes in allocated matrix buffers"},
+        };
+
+        struct HistogramSpec
+        {
+            const char *name;
+            const char *help;
+            const double *bounds;
+            size_t num_bounds;
+        };
+
+        const HistogramSpec HISTOGRAM_SPECS[NUM_HISTOGRAMS] = {
+            {"micro_transformer_batch_size", "Requests per batching-queue batch", BATCH_BOUNDS, std::size(BATCH_BOUNDS)},
+            {"micro_transformer_queue_wait_seconds", "Time from submit to batch start", LATENCY_BOUNDS, std::size(LATENCY_BOUNDS)},
+            {"micro_transformer_forward_seconds", "Encoder forward latency", LATENCY_BOUNDS, std::size(LATENCY_BOUNDS)},
+            {"micro_transformer_attention_seconds", "Per-layer attention latency", LATENCY_BOUNDS, std::size(LATENCY_BOUNDS)},
+            {"micro_transformer_feed_forward_seconds", "Per-layer feed-forward latency", LATENCY_BOUNDS, std::size(LATENCY_BOUNDS)},
+            {"micro_transformer_layer_norm_seconds", "Per-layer normalization latency", LATENCY_BOUNDS, std::size(LATENCY_BOUNDS)},
+        };
+
+        struct HistogramCells
+        {
+            std::array<std::atomic<uint64_t>, MAX_BUCKETS + 1> buckets{}; // Last bucket is +Inf
+            std::atomic<uint64_t> count{0};
+            std::atomic<double> sum{0.0};
+        };
+
+        struct MetricShard
+        {
+            std::array<std::atomic<uint64_t>, NUM_COUNTERS> counters{};
+            std::array<HistogramCells, NUM_HISTOGRAMS> histograms;
+        };
+
+        // Only the owning thread writes a shard cell, so a load and store is enough
+        template <typename T>
+        inline void add_owned(std::atomic<T> &cell, T amount)
+        {
+            cell.store(cell.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        }
+
+        // Moves every cell of `from` into `into` and zeroes `from`; callers hold the registry lock
+        void fold_shard(MetricShard &from, MetricShard &into)
+        {
+            for (size_t c = 0; c < NUM_COUNTERS; ++c)
+            {
+                add_owned(into.counters[c], from.counters[c].exchange(0, std::memory_order_relaxed));
+            }
+            for (size_t h = 0; h < NUM_HISTOGRAMS; ++h)
+            {
+                HistogramCells &source = from.histograms[h];
+                HistogramCells &target = into.histograms[h];
+                for (size_t b = 0; b <= MAX_BUCKETS; ++b)
+                {
+                    add_owned(target.buckets[b], source.buckets[b].exchange(0, std::memory_order_relaxed));
+                }
+                add_owned(target.count, source.count.exchange(0, std::memory_order_relaxed));
+                add_owned(target.sum, source.sum.exchange(0.0, std::memory_order_relaxed));
+            }
+        }
+
+        // Shards are owned by live threads or wait, zeroed, on the free list; counts from
+        // exited threads live in `retired`. The shard count is bounded by peak thread count
+        struct ShardRegistry
+        {
+            std::mutex mutex;
+            std::vector<std::unique_ptr<MetricShard>> shards;
+            std::vector<MetricShard *> free_shards;
+            MetricShard retired;
+        };
+
+        ShardRegistry &shard_registry()
+        {
+            // Never destroyed, so threads still running at exit keep a valid shard
+            static ShardRegistry *registry = new ShardRegistry();
+            return *registry;
+        }
+
+        MetricShard *acquire_shard()
+        {
+            ShardRegistry &registry = shard_registry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            if (!registry.free_shards.empty())
+            {
+                MetricShard *shard = registry.free_shards.back();
+                registry.free_shards.pop_back();
+                return shard;
+            }
+            registry.shards.push_back(std::make_unique<MetricShard>());
+            return registry.shards.back().get();
+        }
+
+        thread_local MetricShard *thread_shard = nullptr;
+        thread_local bool shard_released = false;
+
+        // Hands the thread's shard back at thread exit
+        struct ShardLease
+        {
+            ~ShardLease()
+            {
+                if (!thread_shard)
+                {
+                    return;
+                }
+
+                ShardRegistry &registry = shard_registry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                fold_shard(*thread_shard, registry.retired);
+                registry.free_shards.push_back(thread_shard);
+                thread_shard = nullptr;
+                shard_released = true;
+            }
+        };
+
+        MetricShard &local_shard()
+        {
+            if (!thread_shard)
+            {
+                thread_shard = acquire_shard();
+
+                // Metrics recorded by other thread_local destructors after the lease is
+                // gone keep the fresh shard for good; that only happens during teardown
+                if (!shard_released)
+                {
+                    thread_local ShardLease lease;
+                }
+            }
+            return *thread_shard;
+        }
+
+        // Flight recorder state
+        constexpr size_t FLIGHT_RING_SIZE = 64;
+
+        struct FlightSlot
+        {
+            std::atomic<uint64_t> sequence{0}; // 2 * ticket + 1 while writing, 2 * ticket + 2 when done
+            FlightRecord record;
+        };
+
+        std::atomic<double> slow_threshold{0.0};
+        std::atomic<uint64_t> next_flight_ticket{0};
+        FlightSlot flight_ring[FLIGHT_RING_SIZE];
+
+        thread_local FlightRecorder::Trace *current_trace = nullptr;
+        thread_local uint32_t batch_context[3] = {1, 1, 1}; // batch_size, batch_inputs, waiters
+
+        bool is_op_histogram(Histogram histogram)
+        {
+            return histogram == Histogram::AttentionSeconds || histogram == Histogram::FeedForwardSeconds ||
+                   histogram == Histogram::LayerNormSeconds;
+        }
+
+        const char *op_name(Histogram histogram)
+        {
+            switch (histogram)
+            {
+            case Histogram::AttentionSeconds:
+                return "attention";
+            case Histogram::FeedForwardSeconds:
+                return "feed_forward";
+            case Histogram::LayerNormSeconds:
+                return "layer_norm";
+            default:
+                return "other";
+            }
+        }
+
+        void publish_flight_record(FlightRecord &record)
+        {
+            // Each writer claims its own slot; readers retry-free skip slots whose
+            // sequence changed while they copied
+            uint64_t ticket = next_flight_ticket.fetch_add(1);
+            FlightSlot &slot = flight_ring[ticket % FLIGHT_RING_SIZE];
+            record.id = ticket;
+
+            slot.sequence.store(2 * ticket + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            std::memcpy(&slot.record, &record, sizeof(FlightRecord));
+            slot.sequence.store(2 * ticket + 2, std::memory_order_release);
+        }
+    }
+
+    namespace Metrics
+    {
+
+        void increment(Counter counter, uint64_t amount)
+        {
+            add_owned(local_shard().counters[static_cast<size_t>(counter)], amount);
+        }
+
+        void observe(Histogram histogram, double value)
+        {
+            const HistogramSpec &spec = HISTOGRAM_SPECS[static_cast<size_t>(histogram)];
+            HistogramCells &cells = local_shard().histograms[static_cast<size_t>(histogram)];
+
+            size_t bucket = 0;
+            while (bucket < spec.num_bounds && value > spec.bounds[bucket])
+            {
+                ++bucket;
+            }
+            add_owned(cells.buckets[bucket], uint64_t{1});
+            add_owned(cells.count, uint64_t{1});
+            add_owned(cells.sum, value);
+
+            if (current_trace && is_op_histogram(histogram))
+            {
+                current_trace->add_op(histogram, value);
+            }
+        }
+
+        uint64_t counter_value(Counter counter)
+        {
+            ShardRegistry &registry = shard_registry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+
+            uint64_t total = registry.retired.counters[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+            for (const auto &shard : registry.shards)
+            {
+                total += shard->counters[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+
+        std::string render_prometheus()
+        {
+            // Aggregate first so the text is built without holding the registry lock
+            std::array<uint64_t, NUM_COUNTERS> counters{};
+            std::array<std::array<uint64_t, MAX_BUCKETS + 1>, NUM_HISTOGRAMS> buckets{};
+            std::array<uint64_t, NUM_HISTOGRAMS> counts{};
+            std::array<double, NUM_HISTOGRAMS> sums{};
+            {
+                ShardRegistry &registry = shard_registry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                auto accumulate = [&](const MetricShard &shard)
+                {
+                    for (size_t c = 0; c < NUM_COUNTERS; ++c)
+                    {
+                        counters[c] += shard.counters[c].load(std::memory_order_relaxed);
+                    }
+                    for (size_t h = 0; h < NUM_HISTOGRAMS; ++h)
+                    {
+                        const HistogramCells &cells = shard.histograms[h];
+                        for (size_t b = 0; b <= MAX_BUCKETS; ++b)
+                        {
+                            buckets[h][b] += cells.buckets[b].load(std::memory_order_relaxed);
+                        }
+                        counts[h] += cells.count.load(std::memory_order_relaxed);
+                        sums[h] += cells.sum.load(std::memory_order_relaxed);
+                    }
+                };
+
+                accumulate(registry.retired);
+                for (const auto &shard : registry.shards)
+                {
+                    accumulate(*shard);
+                }
+            }
+
+            std::ostringstream out;
+            out << std::setprecision(10);
+
+            for (size_t c = 0; c < NUM_COUNTERS; ++c)
+            {
+                out << "# HELP " << COUNTER_SPECS[c].name << " " << COUNTER_SPECS[c].help << "\n"
+                    << "# TYPE " << COUNTER_SPECS[c].name << " counter\n"
+                    << COUNTER_SPECS[c].name << " " << counters[c] << "\n";
+            }
+
+            for (size_t h = 0; h < NUM_HISTOGRAMS; ++h)
+            {
+                const HistogramSpec &spec = HISTOGRAM_SPECS[h];
+                out << "# HELP " << spec.name << " " << spec.help << "\n"
+                    << "# TYPE " << spec.name << " histogram\n";
+
+                // Prometheus buckets are cumulative; the +Inf bucket is the sample count.
+                // Reading shards while owners write can leave cells a sample behind the
+                // count, so +Inf is taken from the count itself
+                uint64_t cumulative = 0;
+                for (size_t b = 0; b < spec.num_bounds; ++b)
+                {
+                    cumulative += buckets[h][b];
+                    out << spec.name << "_bucket{le=\"" << spec.bounds[b] << "\"} " << cumulative << "\n";
+                }
+                out << spec.name << "_bucket{le=\"+Inf\"} " << counts[h] << "\n"
+                    << spec.name << "_sum " << sums[h] << "\n"
+                    << spec.name << "_count " << counts[h] << "\n";
+            }
+
+            return out.str();
+        }
+
+    } // namespace Metrics
+
+    // Flight Recorder Implementation
+    namespace FlightRecorder
+    {
+
+        void set_threshold(double seconds)
+        {
+            slow_threshold.store(seconds);
+        }
+
+        double threshold()
+        {
+            return slow_threshold.load(std::memory_order_relaxed);
+        }
+
+        Trace::Trace(size_t rows, size_t cols, size_t threads)
+            : active_(threshold() > 0.0), previous_(current_trace)
+        {
+            if (!active_)
+            {
+                return;
+            }
+
+            record_.threads = static_cast<uint32_t>(threads);
+            record_.rows = static_cast<uint32_t>(rows);
+            record_.cols = static_cast<uint32_t>(cols);
+            record_.batch_size = batch_context[0];
+            record_.batch_inputs = batch_context[1];
+            record_.waiters = batch_context[2];
+            record_.num_ops = 0;
+            record_.dropped_ops = 0;
+
+            current_trace = this;
+            start_ = Metrics::Clock::now();
+        }
+
+        Trace::~Trace()
+        {
+            if (!active_)
+            {
+                return;
+            }
+
+            current_trace = previous_;
+            record_.total_seconds = std::chrono::duration<double>(Metrics::Clock::now() - start_).count();
+            if (record_.total_seconds < threshold())
+            {
+                return;
+            }
+
+            record_.unix_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                       std::chrono::system_clock::now().time_since_epoch())
+                                       .count();
+            publish_flight_record(record_);
+        }
+
+        void Trace::add_op(Histogram kind, double seconds)
+        {
+            if (record_.num_ops == FlightRecord::MAX_OPS)
+            {
+                ++record_.dropped_ops;
+                return;
+            }
+            record_.ops[record_.num_ops++] = {kind, layer_, static_cast<float>(seconds)};
+        }
+
+        BatchScope::BatchScope(size_t batch_size, size_t batch_inputs, size_t waiters)
+        {
+            std::copy(batch_context, batch_context + 3, previous_);
+            batch_context[0] = static_cast<uint32_t>(batch_size);
+            batch_context[1] = static_cast<uint32_t>(batch_inputs);
+            batch_context[2] = static_cast<uint32_t>(waiters);
+        }
+
+        BatchScope::~BatchScope()
+        {
+            std::copy(previous_, previous_ + 3, batch_context);
+        }
+
+        std::vector<FlightRecord> snapshot()
+        {
+            std::vector<FlightRecord> records;
+            FlightRecord copy;
+            for (FlightSlot &slot : flight_ring)
+            {
+                uint64_t before = slot.sequence.load(std::memory_order_acquire);
+                if (before == 0 || before % 2 == 1)
+                {
+                    continue;
+                }
+                std::memcpy(&copy, &slot.record, sizeof(FlightRecord));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.sequence.load(std::memory_order_relaxed) == before)
+                {
+                    records.push_back(copy);
+                }
+            }
+
+            std::sort(records.begin(), records.end(), [](const FlightRecord &a, const FlightRecord &b)
+                      { return a.id < b.id; });
+            return records;
+        }
+
+        void dump(std::ostream &out)
+        {
+            std::vector<FlightRecord> records = snapshot();
+            std::ios::fmtflags flags = out.flags();
+            std::streamsize precision = out.precision();
+            out << "# " << records.size() << " slow forwards (threshold " << threshold() * 1000.0 << " ms)\n";
+
+            for (const FlightRecord &record : records)
+            {
+                out << "record " << record.id << " at " << record.unix_time_ms << ": "
+                    << std::fixed << std::setprecision(3) << record.total_seconds * 1000.0 << " ms, "
+                    << record.rows << "x" << record.cols << " input, " << record.threads << " threads, batch "
+                    << record.batch_size << " (" << record.batch_inputs << " distinct, " << record.waiters
+                    << " waiting on this input)\n";
+                for (uint32_t o = 0; o < record.num_ops; ++o)
+                {
+                    const FlightRecord::Op &op = record.ops[o];
+                    out << "  layer " << op.layer << " " << op_name(op.kind) << " " << op.seconds * 1000.0f << " ms\n";
+                }
+                if (record.dropped_ops > 0)
+                {
+                    out << "  (" << record.dropped_ops << " more ops not recorded)\n";
+                }
+            }
+            out.flags(flags);
+            out.precision(precision);
+            out.flush();
+        }
+
+#ifndef _WIN32
+        namespace
+        {
+            int signal_pipe[2] = {-1, -1};
+            std::mutex dump_mutex;
+            std::string dump_path;
+
+            void on_dump_signal(int)
+            {
+                int saved_errno = errno;
+                char wake = 1;
+                [[maybe_unused]] ssize_t ignored = ::write(signal_pipe[1], &wake, 1);
+                errno = saved_errno;
+            }
+
+            void dump_loop()
+            {
+                char wake;
+                for (;;)
+                {
+                    ssize_t got = ::read(signal_pipe[0], &wake, 1);
+                    if (got < 0 && errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if (got <= 0)
+                    {
+                        return;
+                    }
+
+                    std::lock_guard<std::mutex> lock(dump_mutex);
+                    if (dump_path.empty())
+                    {
+                        dump(std::cerr);
+                    }
+                    else
+                    {
+                        std::ofstream file(dump_path, std::ios::app);
+                        dump(file);
+                    }
+                }
+            }
+        }
+
+        void dump_on_signal(int signal_number, const std::string &path)
+        {
+            std::lock_guard<std::mutex> lock(dump_mutex);
+            dump_path = path;
+
+            if (signal_pipe[0] < 0)
+            {
+                if (::pipe(signal_pipe) != 0)
+                {
+                    throw std::runtime_error(std::string("Failed to create signal pipe: ") + std::strerror(errno));
+                }
+                ::fcntl(signal_pipe[0], F_SETFD, FD_CLOEXEC);
+                ::fcntl(signal_pipe[1], F_SETFD, FD_CLOEXEC);
+                std::thread(dump_loop).detach();
+            }
+
+            struct sigaction action{};
+            action.sa_handler = on_dump_signal;
+            sigemptyset(&action.sa_mask);
+            action.sa_flags = SA_RESTART;
+            if (::sigaction(signal_number, &action, nullptr) != 0)
+            {
+                throw std::runtime_error(std::string("Failed to install signal handler: ") + std::strerror(errno));
+            }
+        }
+#else
+        void dump_on_signal(int signal_number, const std::string &path)
+        {
+            throw std::runtime_error("Signal-triggered dumps require POSIX signals");
+        }
+#endif
+
+    } // namespace FlightRecorder
+
+    // Metrics Server Implementation
+#ifndef _WIN32
+    MetricsServer::MetricsServer(uint16_t port)
+    {
+        listen_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_fd_ < 0)
+        {
+            throw std::runtime_error(std::string("Failed to create metrics socket: ") + std::strerror(errno));
+        }
+        ::fcntl(listen_fd_, F_SETFD, FD_CLOEXEC); // Not inherited by sweep children
+
+        int reuse = 1;
+        ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        socklen_t length = sizeof(address);
+        if (::bind(listen_fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+            ::listen(listen_fd_, 16) != 0 ||
+            ::getsockname(listen_fd_, reinterpret_cast<sockaddr *>(&address), &length) != 0)
+        {
+            std::string error = std::strerror(errno);
+            ::close(listen_fd_);
+            throw std::runtime_error("Failed to listen for metrics on port " + std::to_string(port) + ": " + error);
+        }
+
+        port_ = ntohs(address.sin_port);
+        thread_ = std::thread(&MetricsServer::serve, this);
+    }
+
+    MetricsServer::MetricsServer(const std::string &unix_socket_path)
+        : unix_socket_path_(unix_socket_path)
+    {
+        sockaddr_un address{};
+        if (unix_socket_path.size() >= sizeof(address.sun_path))
+        {
+            throw std::invalid_argument("Unix socket path too long: " + unix_socket_path);
+        }
+
+        listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd_ < 0)
+        {
+            throw std::runtime_error(std::string("Failed to create metrics socket: ") + std::strerror(errno));
+        }
+        ::fcntl(listen_fd_, F_SETFD, FD_CLOEXEC); // Not inherited by sweep children
+
+        // A stale socket file from an earlier run would make bind fail
+        ::unlink(unix_socket_path.c_str());
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, unix_socket_path.c_str(), unix_socket_path.size() + 1);
+        if (::bind(listen_fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+            ::listen(listen_fd_, 16) != 0)
+        {
+            std::string error = std::strerror(errno);
+            ::close(listen_fd_);
+            throw std::runtime_error("Failed to listen for metrics on " + unix_socket_path + ": " + error);
+        }
+
+        thread_ = std::thread(&MetricsServer::serve, this);
+    }
+
+    MetricsServer::~MetricsServer()
+    {
+        stopping_.store(true);
+        thread_.join();
+        ::close(listen_fd_);
+        if (!unix_socket_path_.empty())
+        {
+            ::unlink(unix_socket_path_.c_str());
+        }
+    }
+
+    void MetricsServer::serve()
+    {
+        // Poll with a timeout so shutdown is noticed without a wake-up connection
+        const int POLL_INTERVAL_MS = 200;
+
+        while (!stopping_.load())
+        {
+            pollfd listener{listen_fd_, POLLIN, 0};
+            if (::poll(&listener, 1, POLL_INTERVAL_MS) <= 0)
+            {
+                continue;
+            }
+
+            int client = ::accept(listen_fd_, nullptr, nullptr);
+            if (client < 0)
+            {
+                continue;
+            }
+
+            // Every request gets the metrics page; read what the client sent so closing
+            // the socket does not reset the connection under it
+            char request[4096];
+            pollfd readable{client, POLLIN, 0};
+            if (::poll(&readable, 1, POLL_INTERVAL_MS) > 0)
+            {
+                [[maybe_unused]] ssize_t ignored = ::recv(client, request, sizeof(request), 0);
+            }
+
+            std::string body = Metrics::render_prometheus();
+            std::string response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                                   std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+
+#ifdef MSG_NOSIGNAL
+            const int send_flags = MSG_NOSIGNAL;
+#else
+            const int send_flags = 0;
+#endif
+            size_t sent = 0;
+            while (sent < response.size())
+            {
+                ssize_t written = ::send(client, response.data() + sent, response.size() - sent, send_flags);
+                if (written <= 0)
+                {
+                    break;
+                }
+                sent += static_cast<size_t>(written);
+            }
+            ::close(client);
+        }
+    }
+#else
+    MetricsServer::MetricsServer(uint16_t port)
+    {
+        throw std::runtime_error("MetricsServer requires POSIX sockets");
+    }
+
+    MetricsServer::MetricsServer(const std::string &unix_socket_path)
+    {
+        throw std::runtime_error("MetricsServer requires POSIX sockets");
+    }
+
+    MetricsServer::~MetricsServer() = default;
+
+    void MetricsServer::serve()
+    {
+    }
+#endif
+
+} // namespace MicroTransformer
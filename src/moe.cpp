@@ -0,0 +1,211 @@
+#include "transformer.h"
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <omp.h>
+
+namespace MicroTransformer
+{
+
+    // Mixture-of-Experts Implementation
+    MixtureOfExperts::MixtureOfExperts(const TransformerConfig &config)
+        : config_(config),
+          router_(config.embed_dim, config.num_experts)
+    {
+        if (config.num_experts == 0)
+        {
+            throw std::invalid_argument("num_experts must be positive");
+        }
+        if (config.experts_per_token == 0 || config.experts_per_token > config.num_experts)
+        {
+            throw std::invalid_argument("experts_per_token must be in [1, num_experts]");
+        }
+
+        float limit = std::sqrt(6.0f / (config.embed_dim + config.num_experts));
+        router_.randomize(-limit, limit);
+
+        experts_.reserve(config.num_experts);
+        for (size_t e = 0; e < config.num_experts; ++e)
+        {
+            experts_.push_back(std::make_unique<FeedForwardNetwork>(config));
+        }
+    }
+
+    Matrix MixtureOfExperts::forward(const Matrix &input, bool use_parallel)
+    {
+        if (use_parallel)
+        {
+            return forward_parallel(input);
+        }
+        else
+        {
+            return forward_serial(input);
+        }
+    }
+
+    Matrix MixtureOfExperts::forward_serial(const Matrix &input)
+    {
+        return dispatch(input, false);
+    }
+
+    Matrix MixtureOfExperts::forward_parallel(const Matrix &input)
+    {
+        return dispatch(input, true);
+    }
+
+    void MixtureOfExperts::prune_weights(float sparsity)
+    {
+        for (auto &expert : experts_)
+        {
+            expert->prune_weights(sparsity);
+        }
+    }
+
+    void MixtureOfExperts::compress_low_rank(float error_budget)
+    {
+        for (auto &expert : experts_)
+        {
+            expert->compress_low_rank(error_budget);
+        }
+    }
+
+    size_t MixtureOfExperts::weight_bytes() const
+    {
+        size_t total = router_.bytes();
+        for (const auto &expert : experts_)
+        {
+            total += expert->weight_bytes();
+        }
+        return total;
+    }
+
+    Matrix MixtureOfExperts::dispatch(const Matrix &input, bool use_parallel)
+    {
+        const size_t rows = input.rows();
+        const size_t num_experts = config_.num_experts;
+        const size_t top_k = config_.experts_per_token;
+
+        // Router logits, then top-k experts per row with softmax gates over the selected logits
+        Matrix logits = use_parallel ? input.multiply_blocked(router_) : input * router_;
+        std::vector<size_t> choices(rows * top_k);
+        std::vector<float> gates(rows * top_k);
+
+#pragma omp parallel for if (use_parallel)
+        for (size_t i = 0; i < rows; ++i)
+        {
+            std::vector<size_t> order(num_experts);
+            for (size_t e = 0; e < num_experts; ++e)
+            {
+                order[e] = e;
+            }
+            std::partial_sort(order.begin(), order.begin() + top_k, order.end(), [&](size_t a, size_t b)
+                              { return logits(i, a) > logits(i, b) || (logits(i, a) == logits(i, b) && a < b); });
+
+            float max_logit = logits(i, order[0]);
+            float sum = 0.0f;
+            for (size_t c = 0; c < top_k; ++c)
+            {
+                choices[i * top_k + c] = order[c];
+                gates[i * top_k + c] = std::exp(logits(i, order[c]) - max_logit);
+                sum += gates[i * top_k + c];
+            }
+            for (size_t c = 0; c < top_k; ++c)
+            {
+                gates[i * top_k + c] /= sum;
+            }
+        }
+
+        // Counting sort of (row, choice) assignments by expert. Each assignment gets a
+        // slot so rows of one expert are contiguous and every row knows its k slots
+        std::vector<size_t> expert_offsets(num_experts + 1, 0);
+        for (size_t a = 0; a < rows * top_k; ++a)
+        {
+            ++expert_offsets[choices[a] + 1];
+        }
+        for (size_t e = 0; e < num_experts; ++e)
+        {
+            expert_offsets[e + 1] += expert_offsets[e];
+        }
+
+        std::vector<size_t> slot_rows(rows * top_k);
+        std::vector<size_t> row_slots(rows * top_k);
+        std::vector<size_t> next_slot(expert_offsets.begin(), expert_offsets.end() - 1);
+        for (size_t a = 0; a < rows * top_k; ++a)
+        {
+            size_t slot = next_slot[choices[a]]++;
+            slot_rows[slot] = a / top_k;
+            row_slots[a] = slot;
+        }
+
+        // Work items are row blocks of one expert, so large experts split across threads
+        struct ExpertTask
+        {
+            size_t expert, begin, end;
+        };
+        std::vector<ExpertTask> tasks;
+        for (size_t e = 0; e < num_experts; ++e)
+        {
+            for (size_t begin = expert_offsets[e]; begin < expert_offsets[e + 1]; begin += EXPERT_ROW_BLOCK)
+            {
+                tasks.push_back({e, begin, std::min(begin + EXPERT_ROW_BLOCK, expert_offsets[e + 1])});
+            }
+        }
+
+        Matrix expert_output(rows * top_k, config_.embed_dim);
+        auto run_task = [&](const ExpertTask &task, bool parallel_expert)
+        {
+            Matrix block(task.end - task.begin, config_.embed_dim);
+            for (size_t slot = task.begin; slot < task.end; ++slot)
+            {
+                std::copy_n(&input.data()[slot_rows[slot] * config_.embed_dim], config_.embed_dim,
+                            &block.data()[(slot - task.begin) * config_.embed_dim]);
+            }
+
+            Matrix result = experts_[task.expert]->forward(block, parallel_expert);
+            std::copy_n(result.data(), result.rows() * result.cols(),
+                        &expert_output.data()[task.begin * config_.embed_dim]);
+        };
+
+        // With enough work items parallelize across them; otherwise run them in turn
+        // and let each expert's GEMMs use the whole team
+        if (use_parallel && tasks.size() >= static_cast<size_t>(omp_get_max_threads()))
+        {
+#pragma omp parallel for schedule(dynamic)
+            for (size_t t = 0; t < tasks.size(); ++t)
+            {
+                // Each task is one thread's work. The expert still takes the blocked,
+                // sparse and masked kernels, whose omp_in_parallel() guards keep them
+                // on this thread
+                run_task(tasks[t], true);
+            }
+        }
+        else
+        {
+            for (const ExpertTask &task : tasks)
+            {
+                run_task(task, use_parallel);
+            }
+        }
+
+        // Weighted combine; each row gathers its own slots so no two threads write one row
+        Matrix output(rows, config_.embed_dim);
+
+#pragma omp parallel for if (use_parallel)
+        for (size_t i = 0; i < rows; ++i)
+        {
+            for (size_t c = 0; c < top_k; ++c)
+            {
+                float gate = gates[i * top_k + c];
+                const float *source = &expert_output.data()[row_slots[i * top_k + c] * config_.embed_dim];
+#pragma omp simd
+                for (size_t j = 0; j < config_.embed_dim; ++j)
+                {
+                    output(i, j) += gate * source[j];
+                }
+            }
+        }
+
+        return output;
+    }
+
+} // namespace MicroTransformer
@@ -0,0 +1,352 @@
+#include "transformer.h"
+#include <algorithm>
+#include <stdexcept>
+#include <numeric>
+#include <utility>
+#include <cmath>
+#include <omp.h>
+
+namespace MicroTransformer
+{
+
+    namespace
+    {
+        // One-sided (Hestenes) Jacobi SVD. `columns` holds the n columns of an m x n matrix
+        // A, each contiguous. Column pairs are rotated until all are orthogonal, so that on
+        // return columns[j] = sigma_j * u_j and right[j] = v_j with A = U S V^T. Working on
+        // A itself, rather than eigendecomposing A^T A, keeps the condition number unsquared.
+        void jacobi_svd(std::vector<std::vector<double>> &columns, std::vector<std::vector<double>> &right)
+        {
+            const size_t n = columns.size();
+            const size_t m = n > 0 ? columns[0].size() : 0;
+            right.assign(n, std::vector<double>(n, 0.0));
+            for (size_t j = 0; j < n; ++j)
+            {
+                right[j][j] = 1.0;
+            }
+            if (n < 2)
+            {
+                return;
+            }
+
+            // Round-robin tournament: each step pairs every column with a different partner,
+            // so the n/2 rotations of a step touch disjoint columns and run in one region.
+            // An odd count gets a dummy slot whose pairs are skipped
+            const size_t slots = n + (n % 2);
+            std::vector<size_t> order(slots);
+            std::iota(order.begin(), order.end(), 0);
+            std::vector<std::pair<size_t, size_t>> pairs;
+
+            const size_t MAX_SWEEPS = 50;
+            const double TOLERANCE = 1e-12;
+            for (size_t sweep = 0; sweep < MAX_SWEEPS; ++sweep)
+            {
+                bool rotated = false;
+                for (size_t step = 0; step + 1 < slots; ++step)
+                {
+                    pairs.clear();
+                    for (size_t k = 0; k < slots / 2; ++k)
+                    {
+                        size_t p = order[k], q = order[slots - 1 - k];
+                        if (p < n && q < n)
+                        {
+                            pairs.emplace_back(std::min(p, q), std::max(p, q));
+                        }
+                    }
+
+#pragma omp parallel for reduction(|| : rotated) if (m * pairs.size() > 4096 && !omp_in_parallel())
+                    for (size_t k = 0; k < pairs.size(); ++k)
+                    {
+                        double *ap = columns[pairs[k].first].data();
+                        double *aq = columns[pairs[k].second].data();
+
+                        double alpha = 0.0, beta = 0.0, gamma = 0.0;
+#pragma omp simd reduction(+ : alpha, beta, gamma)
+                        for (size_t i = 0; i < m; ++i)
+                        {
+                            alpha += ap[i] * ap[i];
+                            beta += aq[i] * aq[i];
+                            gamma += ap[i] * aq[i];
+                        }
+                        if (std::abs(gamma) <= TOLERANCE * std::sqrt(alpha * beta))
+                        {
+                            continue;
+                        }
+                        rotated = true;
+
+                        double zeta = (beta - alpha) / (2.0 * gamma);
+                        double t = (zeta >= 0.0 ? 1.0 : -1.0) / (std::abs(zeta) + std::sqrt(zeta * zeta + 1.0));
+                        double c = 1.0 / std::sqrt(t * t + 1.0);
+                        double s = t * c;
+
+#pragma omp simd
+                        for (size_t i = 0; i < m; ++i)
+                        {
+                            double x = ap[i], y = aq[i];
+                            ap[i] = c * x - s * y;
+                            aq[i] = s * x + c * y;
+                        }
+
+                        double *vp = right[pairs[k].first].data();
+                        double *vq = right[pairs[k].second].data();
+#pragma omp simd
+                        for (size_t i = 0; i < n; ++i)
+                        {
+                            double x = vp[i], y = vq[i];
+                            vp[i] = c * x - s * y;
+                            vq[i] = s * x + c * y;
+                        }
+                    }
+
+                    std::rotate(order.begin() + 1, order.end() - 1, order.end());
+                }
+
+                if (!rotated)
+                {
+                    break;
+                }
+            }
+        }
+    }
+
+    // Projection Weight Implementation
+    ProjectionWeight::ProjectionWeight(size_t rows, size_t cols)
+        : rows_(rows), cols_(cols), dense_(rows, cols)
+    {
+    }
+
+    Matrix ProjectionWeight::apply_serial(const Matrix &input) const
+    {
+        if (low_rank_)
+        {
+            return (input * low_rank_->U) * low_rank_->V;
+        }
+        if (sparse_)
+        {
+            // No dense copy is kept once pruned; run the sparse kernel on this thread only
+            Utils::ScopedThreadCount single(1);
+            return input.multiply_sparse(*sparse_);
+        }
+        return input * dense_;
+    }
+
+    Matrix ProjectionWeight::apply_parallel(const Matrix &input) const
+    {
+        if (low_rank_)
+        {
+            return input.multiply_blocked(low_rank_->U).multiply_blocked(low_rank_->V);
+        }
+        if (sparse_)
+        {
+            return input.multiply_sparse(*sparse_);
+        }
+        return input.multiply_blocked(dense_);
+    }
+
+    void ProjectionWeight::prune(float sparsity, size_t block_rows, size_t block_cols, float density_threshold)
+    {
+        if (sparsity < 0.0f || sparsity > 1.0f)
+        {
+            throw std::invalid_argument("Sparsity must be in [0, 1]");
+        }
+        if (low_rank_)
+        {
+            throw std::runtime_error("Cannot prune a low-rank projection weight");
+        }
+        if (block_rows == 0 || block_cols == 0)
+        {
+            throw std::invalid_argument("Block dimensions must be non-zero");
+        }
+        if (sparse_)
+        {
+            dense_ = sparse_->to_dense();
+            sparse_.reset();
+        }
+
+        size_t num_block_rows = (dense_.rows() + block_rows - 1) / block_rows;
+        size_t num_block_cols = (dense_.cols() + block_cols - 1) / block_cols;
+
+        // Block magnitudes (squared Frobenius norm of each tile)
+        std::vector<float> norms(num_block_rows * num_block_cols, 0.0f);
+        for (size_t i = 0; i < dense_.rows(); ++i)
+        {
+            for (size_t j = 0; j < dense_.cols(); ++j)
+            {
+                float value = dense_(i, j);
+                norms[(i / block_rows) * num_block_cols + j / block_cols] += value * value;
+            }
+        }
+
+        size_t num_pruned = static_cast<size_t>(sparsity * static_cast<float>(norms.size()));
+        if (num_pruned > 0)
+        {
+            std::vector<float> sorted_norms = norms;
+            std::nth_element(sorted_norms.begin(), sorted_norms.begin() + (num_pruned - 1), sorted_norms.end());
+            float cutoff = sorted_norms[num_pruned - 1];
+
+            // Zero in the dense matrix, which stays active if the sparse form is not adopted
+            size_t pruned = 0;
+            for (size_t b = 0; b < norms.size() && pruned < num_pruned; ++b)
+            {
+                if (norms[b] > cutoff)
+                {
+                    continue;
+                }
+
+                size_t i_begin = (b / num_block_cols) * block_rows;
+                size_t j_begin = (b % num_block_cols) * block_cols;
+                for (size_t i = i_begin; i < std::min(i_begin + block_rows, dense_.rows()); ++i)
+                {
+                    for (size_t j = j_begin; j < std::min(j_begin + block_cols, dense_.cols()); ++j)
+                    {
+                        dense_(i, j) = 0.0f;
+                    }
+                }
+                ++pruned;
+            }
+        }
+
+        sparse_ = std::make_unique<BlockSparseMatrix>(dense_, block_rows, block_cols);
+        if (sparse_->density() >= density_threshold)
+        {
+            sparse_.reset();
+        }
+        else
+        {
+            dense_ = Matrix(0, 0);
+        }
+    }
+
+    void ProjectionWeight::set_low_rank(std::shared_ptr<const LowRankFactors> factors)
+    {
+        if (!factors || factors->U.rows() != rows_ || factors->V.cols() != cols_ ||
+            factors->U.cols() != factors->V.rows())
+        {
+            throw std::invalid_argument("Low-rank factor dimensions don't match the projection weight");
+        }
+
+        low_rank_ = std::move(factors);
+        sparse_.reset();
+        dense_ = Matrix(0, 0);
+    }
+
+    void ProjectionWeight::set_dense(const Matrix &weight)
+    {
+        if (weight.rows() != rows_ || weight.cols() != cols_)
+        {
+            throw std::invalid_argument("Checkpoint weight has the wrong shape: projection");
+        }
+        dense_ = weight;
+        sparse_.reset();
+        low_rank_.reset();
+    }
+
+    Matrix ProjectionWeight::to_dense() const
+    {
+        if (low_rank_)
+        {
+            return low_rank_->U * low_rank_->V;
+        }
+        return sparse_ ? sparse_->to_dense() : dense_;
+    }
+
+    size_t ProjectionWeight::bytes() const
+    {
+        size_t total = dense_.bytes();
+        if (sparse_)
+        {
+            total += sparse_->bytes();
+        }
+        if (low_rank_)
+        {
+            total += low_rank_->U.bytes() + low_rank_->V.bytes();
+        }
+        return total;
+    }
+
+    size_t ProjectionWeight::compress_low_rank(float error_budget)
+    {
+        if (low_rank_)
+        {
+            return low_rank_->rank();
+        }
+
+        // SVD with the smaller side as the column count. For a wide W (rows <= cols) take
+        // A = W^T, so W = V S U^T: U_r-factor = V_r and V_r-factor = S_r U_r^T. For a tall
+        // W take A = W: U_r-factor = U_r S_r and V_r-factor = V_r^T. Either way the rotated
+        // columns of A are already the scaled singular vectors
+        const bool left = rows_ <= cols_;
+        const size_t n = left ? rows_ : cols_;
+        const size_t m = left ? cols_ : rows_;
+        const Matrix weight = to_dense();
+
+        std::vector<std::vector<double>> columns(n, std::vector<double>(m));
+        for (size_t j = 0; j < n; ++j)
+        {
+            for (size_t i = 0; i < m; ++i)
+            {
+                columns[j][i] = left ? weight(j, i) : weight(i, j);
+            }
+        }
+
+        std::vector<std::vector<double>> right;
+        jacobi_svd(columns, right);
+
+        std::vector<double> energy(n, 0.0);
+        for (size_t j = 0; j < n; ++j)
+        {
+            for (double value : columns[j])
+            {
+                energy[j] += value * value;
+            }
+        }
+
+        std::vector<size_t> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](size_t x, size_t y)
+                  { return energy[x] > energy[y]; });
+
+        // Squared singular values sum to ||W||_F^2; keep the fewest that leave the
+        // dropped energy within the budget
+        double total = std::accumulate(energy.begin(), energy.end(), 0.0);
+        double allowed = static_cast<double>(error_budget) * error_budget * total;
+        double dropped = total;
+        size_t rank = 0;
+        while (rank < n && dropped > allowed)
+        {
+            dropped -= energy[order[rank]];
+            ++rank;
+        }
+        rank = std::max<size_t>(rank, 1);
+
+        if (rank * (rows_ + cols_) >= rows_ * cols_)
+        {
+            return 0;
+        }
+
+        // basis: n x rank right singular vectors; scaled: rank x m scaled left singular vectors
+        Matrix basis(n, rank);
+        Matrix scaled(rank, m);
+        for (size_t r = 0; r < rank; ++r)
+        {
+            const std::vector<double> &v = right[order[r]];
+            const std::vector<double> &a = columns[order[r]];
+            for (size_t i = 0; i < n; ++i)
+            {
+                basis(i, r) = static_cast<float>(v[i]);
+            }
+            for (size_t i = 0; i < m; ++i)
+            {
+                scaled(r, i) = static_cast<float>(a[i]);
+            }
+        }
+
+        std::shared_ptr<LowRankFactors> factors =
+            left ? std::make_shared<LowRankFactors>(LowRankFactors{std::move(basis), std::move(scaled)})
+                 : std::make_shared<LowRankFactors>(LowRankFactors{scaled.transpose(), basis.transpose()});
+
+        set_low_rank(std::move(factors));
+        return rank;
+    }
+
+} // namespace MicroTransformer
@@ -0,0 +1,151 @@
+#include "runtime.h"
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <omp.h>
+
+namespace MicroTransformer
+{
+
+    // Model Registry Implementation
+    ModelRegistry::ModelRegistry(ModelLoader loader, size_t memory_budget_bytes, size_t concurrent_forwards)
+        : loader_(std::move(loader)), memory_budget_(memory_budget_bytes),
+          forward_slots_(concurrent_forwards > 0 ? concurrent_forwards
+                                                 : static_cast<size_t>(std::max(1, omp_get_max_threads() / 4))),
+          team_threads_(std::max(1, omp_get_max_threads() / static_cast<int>(std::min<size_t>(forward_slots_, omp_get_max_threads())))),
+          compute_slots_(static_cast<std::ptrdiff_t>(forward_slots_)),
+          thread_model_(PerformanceBenchmark::shared_thread_model())
+    {
+        if (!loader_)
+        {
+            throw std::invalid_argument("ModelRegistry needs a model loader");
+        }
+    }
+
+    std::shared_ptr<TransformerEncoder> ModelRegistry::acquire(const std::string &name)
+    {
+        std::promise<std::shared_ptr<TransformerEncoder>> loaded;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto found = index_.find(name);
+            if (found != index_.end())
+            {
+                lru_.splice(lru_.begin(), lru_, found->second);
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return found->second->encoder;
+            }
+
+            auto in_progress = loading_.find(name);
+            if (in_progress != loading_.end())
+            {
+                std::shared_future<std::shared_ptr<TransformerEncoder>> pending = in_progress->second;
+                lock.unlock();
+                return pending.get();
+            }
+
+            loading_.emplace(name, loaded.get_future().share());
+        }
+
+        // Load outside the lock so other models keep serving meanwhile
+        std::shared_ptr<TransformerEncoder> encoder;
+        try
+        {
+            encoder = loader_(name);
+            if (!encoder)
+            {
+                throw std::runtime_error("Model loader returned no model for: " + name);
+            }
+            encoder->set_thread_model(thread_model_);
+        }
+        catch (...)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                loading_.erase(name);
+            }
+            loaded.set_exception(std::current_exception());
+            throw;
+        }
+
+        size_t bytes = encoder->weight_bytes();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            loading_.erase(name);
+            make_room(bytes);
+            lru_.push_front({name, encoder, bytes});
+            index_.emplace(name, lru_.begin());
+            resident_bytes_ += bytes;
+        }
+        loads_.fetch_add(1, std::memory_order_relaxed);
+        Metrics::increment(Counter::ModelLoads);
+
+        loaded.set_value(encoder);
+        return encoder;
+    }
+
+    Matrix ModelRegistry::forward(const std::string &name, const Matrix &input, bool use_parallel)
+    {
+        // The reference keeps the model alive even if it is evicted mid-forward
+        std::shared_ptr<TransformerEncoder> encoder = acquire(name);
+
+        compute_slots_.acquire();
+        try
+        {
+            Utils::ScopedThreadCount team(team_threads_);
+            Matrix output = encoder->forward(input, use_parallel);
+            compute_slots_.release();
+            return output;
+        }
+        catch (...)
+        {
+            compute_slots_.release();
+            throw;
+        }
+    }
+
+    bool ModelRegistry::resident(const std::string &name) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return index_.count(name) != 0;
+    }
+
+    void ModelRegistry::evict(const std::string &name)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = index_.find(name);
+        if (found == index_.end())
+        {
+            return;
+        }
+
+        resident_bytes_ -= found->second->bytes;
+        lru_.erase(found->second);
+        index_.erase(found);
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+        Metrics::increment(Counter::ModelEvictions);
+    }
+
+    RegistryStats ModelRegistry::stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return {hits_.load(std::memory_order_relaxed),
+                loads_.load(std::memory_order_relaxed),
+                evictions_.load(std::memory_order_relaxed),
+                lru_.size(), resident_bytes_};
+    }
+
+    void ModelRegistry::make_room(size_t bytes)
+    {
+        // A model larger than the whole budget still loads, alone
+        while (!lru_.empty() && resident_bytes_ + bytes > memory_budget_)
+        {
+            const Resident &victim = lru_.back();
+            resident_bytes_ -= victim.bytes;
+            index_.erase(victim.name);
+            lru_.pop_back();
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+            Metrics::increment(Counter::ModelEvictions);
+        }
+    }
+
+} // namespace MicroTransformer
@@ -0,0 +1,165 @@
+#include "transformer.h"
+#include <algorithm>
+#include <stdexcept>
+#include <omp.h>
+
+namespace MicroTransformer
+{
+
+    // Block-CSR Matrix Implementation
+    BlockSparseMatrix::BlockSparseMatrix(const Matrix &dense, size_t block_rows, size_t block_cols)
+        : rows_(dense.rows()), cols_(dense.cols()),
+          block_rows_(block_rows), block_cols_(block_cols)
+    {
+        if (block_rows == 0 || block_cols == 0)
+        {
+            throw std::invalid_argument("Block dimensions must be non-zero");
+        }
+
+        size_t num_block_rows = (rows_ + block_rows_ - 1) / block_rows_;
+        size_t num_block_cols = (cols_ + block_cols_ - 1) / block_cols_;
+        block_row_offsets_.reserve(num_block_rows + 1);
+        block_row_offsets_.push_back(0);
+
+        for (size_t br = 0; br < num_block_rows; ++br)
+        {
+            size_t i_begin = br * block_rows_;
+            size_t i_end = std::min(i_begin + block_rows_, rows_);
+
+            for (size_t bc = 0; bc < num_block_cols; ++bc)
+            {
+                size_t j_begin = bc * block_cols_;
+                size_t j_end = std::min(j_begin + block_cols_, cols_);
+
+                bool has_nonzero = false;
+                for (size_t i = i_begin; i < i_end && !has_nonzero; ++i)
+                {
+                    for (size_t j = j_begin; j < j_end; ++j)
+                    {
+                        if (dense(i, j) != 0.0f)
+                        {
+                            has_nonzero = true;
+                            break;
+                        }
+                    }
+                }
+
+                if (!has_nonzero)
+                {
+                    continue;
+                }
+
+                // Edge blocks are zero-padded so every stored block has the same shape
+                block_cols_index_.push_back(bc);
+                size_t base = values_.size();
+                values_.resize(base + block_rows_ * block_cols_, 0.0f);
+                for (size_t i = i_begin; i < i_end; ++i)
+                {
+                    for (size_t j = j_begin; j < j_end; ++j)
+                    {
+                        values_[base + (i - i_begin) * block_cols_ + (j - j_begin)] = dense(i, j);
+                    }
+                }
+            }
+
+            block_row_offsets_.push_back(block_cols_index_.size());
+        }
+    }
+
+    float BlockSparseMatrix::density() const
+    {
+        size_t num_block_rows = (rows_ + block_rows_ - 1) / block_rows_;
+        size_t num_block_cols = (cols_ + block_cols_ - 1) / block_cols_;
+        size_t total_blocks = num_block_rows * num_block_cols;
+        return total_blocks == 0 ? 0.0f : static_cast<float>(stored_blocks()) / static_cast<float>(total_blocks);
+    }
+
+    size_t BlockSparseMatrix::bytes() const
+    {
+        return (block_row_offsets_.size() + block_cols_index_.size()) * sizeof(size_t) +
+               values_.size() * sizeof(float);
+    }
+
+    Matrix BlockSparseMatrix::to_dense() const
+    {
+        Matrix result(rows_, cols_);
+
+        for (size_t br = 0; br + 1 < block_row_offsets_.size(); ++br)
+        {
+            for (size_t b = block_row_offsets_[br]; b < block_row_offsets_[br + 1]; ++b)
+            {
+                const float *block = &values_[b * block_rows_ * block_cols_];
+                for (size_t bi = 0; bi < block_rows_ && br * block_rows_ + bi < rows_; ++bi)
+                {
+                    for (size_t bj = 0; bj < block_cols_ && block_cols_index_[b] * block_cols_ + bj < cols_; ++bj)
+                    {
+                        result(br * block_rows_ + bi, block_cols_index_[b] * block_cols_ + bj) = block[bi * block_cols_ + bj];
+                    }
+                }
+            }
+        }
+
+        return result;
+    }
+
+    Matrix Matrix::multiply_sparse(const BlockSparseMatrix &other) const
+    {
+        if (cols_ != other.rows_)
+        {
+            throw std::invalid_argument("Matrix dimensions don't match for multiplication");
+        }
+
+        Matrix result(rows_, other.cols_);
+
+        // Each task owns a tile of output rows, so the weight blocks it streams are
+        // reused across ROW_TILE activation rows and no two tasks write the same row
+        const size_t ROW_TILE = 8;
+        const size_t br_size = other.block_rows_;
+        const size_t bc_size = other.block_cols_;
+        const size_t num_block_rows = other.block_row_offsets_.size() - 1;
+
+#pragma omp parallel for if (!omp_in_parallel()) schedule(dynamic)
+        for (size_t ti = 0; ti < rows_; ti += ROW_TILE)
+        {
+            size_t i_end = std::min(ti + ROW_TILE, rows_);
+
+            for (size_t kb = 0; kb < num_block_rows; ++kb)
+            {
+                size_t k_begin = kb * br_size;
+                size_t k_count = std::min(br_size, cols_ - k_begin);
+
+                for (size_t b = other.block_row_offsets_[kb]; b < other.block_row_offsets_[kb + 1]; ++b)
+                {
+                    const float *block = &other.values_[b * br_size * bc_size];
+                    size_t j_begin = other.block_cols_index_[b] * bc_size;
+                    size_t j_count = std::min(bc_size, other.cols_ - j_begin);
+
+                    for (size_t i = ti; i < i_end; ++i)
+                    {
+                        float *out_row = &result.data_[i * other.cols_ + j_begin];
+                        const float *in_row = &data_[i * cols_ + k_begin];
+
+                        for (size_t kk = 0; kk < k_count; ++kk)
+                        {
+                            float a = in_row[kk];
+                            if (a == 0.0f)
+                            {
+                                continue;
+                            }
+
+                            const float *block_row = block + kk * bc_size;
+#pragma omp simd
+                            for (size_t jj = 0; jj < j_count; ++jj)
+                            {
+                                out_row[jj] += a * block_row[jj];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        return result;
+    }
+
+} // namespace MicroTransformer
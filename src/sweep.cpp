@@ -0,0 +1,274 @@
+#include "transformer.h"
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+namespace MicroTransformer
+{
+
+    int PerformanceBenchmark::run_sweep_point(int argc, char **argv)
+    {
+        // --sweep-point <result_fd> <seq_length> <embed_dim> <num_heads> <ff_dim> <num_layers>
+        //               <use_parallel> <num_runs> <measure_cold>
+        if (argc != 11 || std::string(argv[1]) != "--sweep-point")
+        {
+            std::cerr << "Malformed sweep point arguments" << std::endl;
+            return 2;
+        }
+
+        try
+        {
+            const int result_fd = std::stoi(argv[2]);
+            TransformerConfig config;
+            config.seq_length = std::stoul(argv[3]);
+            config.embed_dim = std::stoul(argv[4]);
+            config.num_heads = std::stoul(argv[5]);
+            config.ff_dim = std::stoul(argv[6]);
+            config.num_layers = std::stoul(argv[7]);
+            const bool use_parallel = std::stoi(argv[8]) != 0;
+            const size_t num_runs = std::stoul(argv[9]);
+            const bool measure_cold = std::stoi(argv[10]) != 0;
+
+            Matrix input = Utils::generate_random_input(config.seq_length, config.embed_dim);
+            TransformerEncoder encoder(config);
+            BenchmarkResult result = measure_execution(encoder, input, use_parallel, num_runs, measure_cold);
+
+            char line[256];
+            const ComparisonStats &comparison = result.comparison;
+            int length = std::snprintf(line, sizeof(line), "%.6f %.6f %zu %d %.9e %.9e %llu %.9e %zu %zu\n",
+                                       result.execution_time_ms, result.cold_execution_time_ms,
+                                       result.thread_count, result.numerical_correctness ? 1 : 0,
+                                       result.max_deviation, comparison.max_rel_error,
+                                       static_cast<unsigned long long>(comparison.max_ulp_distance),
+                                       comparison.rms_error, comparison.worst_row, comparison.worst_col);
+#ifndef _WIN32
+            if (length <= 0 || ::write(result_fd, line, static_cast<size_t>(length)) != length)
+            {
+                std::cerr << "Failed to report sweep point result" << std::endl;
+                return 1;
+            }
+#else
+            (void)result_fd;
+            (void)length;
+            throw std::runtime_error("Process-isolated sweeps require POSIX");
+#endif
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Sweep point failed: " << e.what() << std::endl;
+            return 1;
+        }
+
+        return 0;
+    }
+
+#ifndef _WIN32
+    namespace
+    {
+        // Start one sweep point and parse the line it writes to its result pipe
+        BenchmarkResult run_isolated_point(const std::string &executable, const TransformerConfig &config,
+                                           size_t thread_count, bool use_parallel, size_t num_runs,
+                                           const SweepOptions &options)
+        {
+            int fds[2];
+            if (::pipe(fds) != 0)
+            {
+                throw std::runtime_error(std::string("Failed to create sweep pipe: ") + std::strerror(errno));
+            }
+
+            // Neither end may leak into children forked for other points or by other
+            // threads; only this point's child re-enables the write end before exec
+            ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+            ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+            // Everything the child needs is built before fork: after it, only
+            // async-signal-safe calls are allowed in a multithreaded parent
+            std::vector<std::string> args = {
+                executable, "--sweep-point", std::to_string(fds[1]),
+                std::to_string(config.seq_length), std::to_string(config.embed_dim),
+                std::to_string(config.num_heads), std::to_string(config.ff_dim),
+                std::to_string(config.num_layers), use_parallel ? "1" : "0",
+                std::to_string(num_runs), options.measure_cold ? "1" : "0"};
+
+            std::vector<std::string> overrides = {"OMP_NUM_THREADS=" + std::to_string(thread_count)};
+            if (!options.proc_bind.empty())
+            {
+                overrides.push_back("OMP_PROC_BIND=" + options.proc_bind);
+            }
+            if (!options.places.empty())
+            {
+                overrides.push_back("OMP_PLACES=" + options.places);
+            }
+
+            std::vector<std::string> environment;
+            for (char **entry = environ; *entry != nullptr; ++entry)
+            {
+                std::string variable(*entry);
+                bool overridden = false;
+                for (const std::string &override_entry : overrides)
+                {
+                    size_t name_length = override_entry.find('=') + 1;
+                    overridden = overridden || variable.compare(0, name_length, override_entry, 0, name_length) == 0;
+                }
+                if (!overridden)
+                {
+                    environment.push_back(std::move(variable));
+                }
+            }
+            environment.insert(environment.end(), overrides.begin(), overrides.end());
+
+            std::vector<char *> argv, envp;
+            for (std::string &arg : args)
+            {
+                argv.push_back(arg.data());
+            }
+            argv.push_back(nullptr);
+            for (std::string &variable : environment)
+            {
+                envp.push_back(variable.data());
+            }
+            envp.push_back(nullptr);
+
+            pid_t pid = ::fork();
+            if (pid < 0)
+            {
+                ::close(fds[0]);
+                ::close(fds[1]);
+                throw std::runtime_error(std::string("Failed to fork sweep point: ") + std::strerror(errno));
+            }
+            if (pid == 0)
+            {
+                // The child's own progress output would interleave with the sweep report
+                ::close(fds[0]);
+                ::fcntl(fds[1], F_SETFD, 0);
+                int devnull = ::open("/dev/null", O_WRONLY);
+                if (devnull >= 0)
+                {
+                    ::dup2(devnull, STDOUT_FILENO);
+                    ::close(devnull);
+                }
+                ::execve(executable.c_str(), argv.data(), envp.data());
+                ::_exit(127);
+            }
+
+            ::close(fds[1]);
+            std::string output;
+            char buffer[256];
+            for (;;)
+            {
+                ssize_t got = ::read(fds[0], buffer, sizeof(buffer));
+                if (got > 0)
+                {
+                    output.append(buffer, static_cast<size_t>(got));
+                }
+                else if (got == 0 || errno != EINTR)
+                {
+                    break;
+                }
+            }
+            ::close(fds[0]);
+
+            int status = 0;
+            while (::waitpid(pid, &status, 0) < 0 && errno == EINTR)
+            {
+            }
+            if (WIFEXITED(status) && WEXITSTATUS(status) == 127)
+            {
+                throw std::runtime_error("Failed to execute sweep point binary: " + executable);
+            }
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            {
+                throw std::runtime_error("Sweep point failed for seq_length " + std::to_string(config.seq_length) +
+                                         " with " + std::to_string(thread_count) + " threads");
+            }
+
+            BenchmarkResult result;
+            result.config = config;
+            result.implementation_type = use_parallel ? "Parallel" : "Serial";
+            int correct = 0;
+            std::istringstream line(output);
+            ComparisonStats &comparison = result.comparison;
+            if (!(line >> result.execution_time_ms >> result.cold_execution_time_ms >> result.thread_count >>
+                  correct >> result.max_deviation >> comparison.max_rel_error >> comparison.max_ulp_distance >>
+                  comparison.rms_error >> comparison.worst_row >> comparison.worst_col))
+            {
+                throw std::runtime_error("Malformed sweep point result: " + output);
+            }
+            result.numerical_correctness = correct != 0;
+            comparison.max_abs_error = result.max_deviation;
+            return result;
+        }
+    }
+
+    std::vector<BenchmarkResult> PerformanceBenchmark::isolated_scalability_test(
+        const std::string &executable,
+        const TransformerConfig &base_config,
+        const std::vector<size_t> &thread_counts,
+        const std::vector<size_t> &sequence_lengths,
+        size_t num_runs,
+        const SweepOptions &options)
+    {
+        std::vector<BenchmarkResult> results;
+
+        for (size_t seq_len : sequence_lengths)
+        {
+            TransformerConfig config = base_config;
+            config.seq_length = seq_len;
+
+            std::cout << "\nTesting sequence length: " << seq_len << " (isolated processes)" << std::endl;
+
+            BenchmarkResult serial_result = run_isolated_point(executable, config, 1, false, num_runs, options);
+            results.push_back(serial_result);
+            std::cout << "  Serial: " << std::fixed << std::setprecision(3)
+                      << serial_result.execution_time_ms << " ms" << std::endl;
+
+            for (size_t thread_count : thread_counts)
+            {
+                if (thread_count == 1)
+                    continue; // Already tested serial
+
+                BenchmarkResult parallel_result = run_isolated_point(executable, config, thread_count, true,
+                                                                     num_runs, options);
+                results.push_back(parallel_result);
+
+                double speedup = serial_result.execution_time_ms / parallel_result.execution_time_ms;
+                std::cout << "  " << thread_count << " threads: "
+                          << std::fixed << std::setprecision(3) << parallel_result.execution_time_ms
+                          << " ms (speedup: " << std::setprecision(2) << speedup << "x, "
+                          << "correctness: " << (parallel_result.numerical_correctness ? "PASS" : "FAIL")
+                          << ", max_dev: " << std::scientific << parallel_result.max_deviation
+                          << ", max_ulp: " << parallel_result.comparison.max_ulp_distance << ")"
+                          << std::endl;
+            }
+        }
+
+        return results;
+    }
+#else
+    std::vector<BenchmarkResult> PerformanceBenchmark::isolated_scalability_test(
+        const std::string &executable,
+        const TransformerConfig &base_config,
+        const std::vector<size_t> &thread_counts,
+        const std::vector<size_t> &sequence_lengths,
+        size_t num_runs,
+        const SweepOptions &options)
+    {
+        throw std::runtime_error("Process-isolated sweeps require POSIX");
+    }
+#endif
+
+} // namespace MicroTransformer
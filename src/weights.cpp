@@ -0,0 +1,458 @@
+#include "transformer.h"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace MicroTransformer
+{
+
+    namespace
+    {
+        const char CHECKPOINT_MAGIC[4] = {'M', 'T', 'W', 'T'};
+        const uint32_t CHECKPOINT_VERSION = 1;
+
+        void check_shape(const Matrix &matrix, size_t rows, size_t cols, const char *name)
+        {
+            if (matrix.rows() != rows || matrix.cols() != cols)
+            {
+                throw std::invalid_argument(std::string("Checkpoint weight has the wrong shape: ") + name);
+            }
+        }
+
+        // Every config field, in file order. Used for both save and load so the two cannot drift.
+        template <typename Config, typename Visitor>
+        void visit_config(Config &config, Visitor &&field)
+        {
+            field(config.seq_length);
+            field(config.embed_dim);
+            field(config.num_heads);
+            field(config.ff_dim);
+            field(config.num_layers);
+            field(config.dropout_rate);
+            field(config.epsilon);
+            field(config.sparse_block_rows);
+            field(config.sparse_block_cols);
+            field(config.sparse_density_threshold);
+            field(config.activation_sparsity_threshold);
+            field(config.attention_type);
+            field(config.feature_map);
+            field(config.num_random_features);
+            field(config.linformer_rank);
+            field(config.num_experts);
+            field(config.experts_per_token);
+            field(config.token_reduction);
+            field(config.tokens_reduced_per_layer);
+            field(config.keep_first_token);
+            field(config.vocab_size);
+            field(config.embedding_storage);
+            field(config.positional_encoding);
+            field(config.rotary_embeddings);
+            field(config.rope_theta);
+            field(config.position_bias);
+            field(config.relative_buckets);
+            field(config.relative_max_distance);
+        }
+
+        // Layer matrices in file order; random features follow as a counted list
+        template <typename Layer, typename Visitor>
+        void visit_layer(Layer &layer, Visitor &&matrix)
+        {
+            matrix(layer.W_q);
+            matrix(layer.W_k);
+            matrix(layer.W_v);
+            matrix(layer.W_o);
+            matrix(layer.linformer_E);
+            matrix(layer.linformer_F);
+            matrix(layer.relative_bias);
+            matrix(layer.W1);
+            matrix(layer.b1);
+            matrix(layer.W2);
+            matrix(layer.b2);
+            matrix(layer.norm1_gamma);
+            matrix(layer.norm1_beta);
+            matrix(layer.norm2_gamma);
+            matrix(layer.norm2_beta);
+        }
+
+        template <typename T>
+        void write_raw(std::ofstream &out, const T &value)
+        {
+            out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+        }
+
+        template <typename T>
+        void read_raw(std::ifstream &in, T &value)
+        {
+            in.read(reinterpret_cast<char *>(&value), sizeof(T));
+        }
+
+        // Last enumerator of every enum stored in the config
+        constexpr AttentionType last_value(AttentionType) { return AttentionType::Linformer; }
+        constexpr FeatureMap last_value(FeatureMap) { return FeatureMap::RandomFeatures; }
+        constexpr TokenReduction last_value(TokenReduction) { return TokenReduction::Merge; }
+        constexpr EmbeddingStorage last_value(EmbeddingStorage) { return EmbeddingStorage::Int8; }
+        constexpr PositionalEncoding last_value(PositionalEncoding) { return PositionalEncoding::Learned; }
+        constexpr PositionBias last_value(PositionBias) { return PositionBias::T5Relative; }
+
+        // Enums and bools go through their raw representation first, so a corrupt
+        // file cannot produce a value outside the type
+        template <typename T>
+        void read_config_field(std::ifstream &in, T &value)
+        {
+            if constexpr (std::is_enum_v<T>)
+            {
+                std::underlying_type_t<T> raw{};
+                read_raw(in, raw);
+                const auto index = static_cast<long long>(raw);
+                if (index < 0 || index > static_cast<long long>(last_value(T{})))
+                {
+                    throw std::invalid_argument("Checkpoint config has an out-of-range enum value");
+                }
+                value = static_cast<T>(raw);
+            }
+            else if constexpr (std::is_same_v<T, bool>)
+            {
+                static_assert(sizeof(bool) == sizeof(uint8_t), "Checkpoints store bools as one byte");
+                uint8_t raw = 0;
+                read_raw(in, raw);
+                if (raw > 1)
+                {
+                    throw std::invalid_argument("Checkpoint config has an invalid bool value");
+                }
+                value = raw != 0;
+            }
+            else
+            {
+                read_raw(in, value);
+            }
+        }
+
+        // Rejects configs ModelWeights cannot describe before any layer is built
+        const TransformerConfig &checkpoint_config(const ModelWeights &weights)
+        {
+            if (weights.config.vocab_size > 0)
+            {
+                throw std::invalid_argument("ModelWeights does not cover token embedding tables");
+            }
+            if (weights.config.num_experts > 0)
+            {
+                throw std::invalid_argument("ModelWeights does not cover mixture-of-experts layers");
+            }
+            return weights.config;
+        }
+
+        void write_matrix(std::ofstream &out, const Matrix &matrix)
+        {
+            write_raw(out, static_cast<uint64_t>(matrix.rows()));
+            write_raw(out, static_cast<uint64_t>(matrix.cols()));
+            out.write(reinterpret_cast<const char *>(matrix.data()), static_cast<std::streamsize>(matrix.bytes()));
+        }
+
+        struct MatrixShape
+        {
+            uint64_t rows = 0, cols = 0;
+            const char *name = "";
+        };
+
+        // Shape of every checkpoint matrix for `config`, mirroring the layer constructors
+        struct LayerShapes
+        {
+            MatrixShape W_q, W_k, W_v, W_o, linformer_E, linformer_F, relative_bias;
+            MatrixShape W1, b1, W2, b2, norm1_gamma, norm1_beta, norm2_gamma, norm2_beta;
+            MatrixShape random_features;
+            uint64_t num_random_features = 0;
+        };
+
+        LayerShapes layer_shapes(const TransformerConfig &config)
+        {
+            if (config.num_heads == 0 || config.embed_dim % config.num_heads != 0)
+            {
+                throw std::invalid_argument("Checkpoint config has embed_dim not divisible by num_heads");
+            }
+
+            const uint64_t e = config.embed_dim, f = config.ff_dim, n = config.seq_length;
+            const uint64_t rank = config.attention_type == AttentionType::Linformer ? config.linformer_rank : 0;
+            const uint64_t buckets = config.position_bias == PositionBias::T5Relative ? config.relative_buckets : 0;
+            const bool random_features = config.attention_type == AttentionType::Linear &&
+                                         config.feature_map == FeatureMap::RandomFeatures;
+
+            LayerShapes shapes;
+            shapes.W_q = {e, e, "W_q"};
+            shapes.W_k = {e, e, "W_k"};
+            shapes.W_v = {e, e, "W_v"};
+            shapes.W_o = {e, e, "W_o"};
+            shapes.linformer_E = {rank, n, "linformer_E"};
+            shapes.linformer_F = {rank, n, "linformer_F"};
+            shapes.relative_bias = {buckets, config.num_heads, "relative_bias"};
+            shapes.W1 = {e, f, "W1"};
+            shapes.b1 = {1, f, "b1"};
+            shapes.W2 = {f, e, "W2"};
+            shapes.b2 = {1, e, "b2"};
+            shapes.norm1_gamma = {1, e, "norm1_gamma"};
+            shapes.norm1_beta = {1, e, "norm1_beta"};
+            shapes.norm2_gamma = {1, e, "norm2_gamma"};
+            shapes.norm2_beta = {1, e, "norm2_beta"};
+            shapes.random_features = {e / config.num_heads, config.num_random_features, "random_features"};
+            shapes.num_random_features = random_features ? config.num_heads : 0;
+            return shapes;
+        }
+
+        // The header is checked against `expected` and against the bytes left in the
+        // file before anything is allocated, so a corrupt size cannot exhaust memory
+        void read_matrix(std::ifstream &in, Matrix &matrix, const MatrixShape &expected, std::streamoff file_size)
+        {
+            uint64_t rows = 0, cols = 0;
+            read_raw(in, rows);
+            read_raw(in, cols);
+            if (!in)
+            {
+                throw std::runtime_error("Truncated checkpoint");
+            }
+            if (rows != expected.rows || cols != expected.cols)
+            {
+                throw std::invalid_argument(std::string("Checkpoint weight has the wrong shape: ") + expected.name);
+            }
+
+            const uint64_t remaining = static_cast<uint64_t>(file_size - in.tellg()) / sizeof(float);
+            if (cols != 0 && rows > remaining / cols)
+            {
+                throw std::runtime_error("Truncated checkpoint");
+            }
+
+            matrix = Matrix(static_cast<size_t>(rows), static_cast<size_t>(cols));
+            in.read(reinterpret_cast<char *>(matrix.data()), static_cast<std::streamsize>(matrix.bytes()));
+            if (!in)
+            {
+                throw std::runtime_error("Truncated checkpoint");
+            }
+        }
+    }
+
+    // Checkpoint files hold the values in host byte order: magic, version, config
+    // fields, layer count, then each layer's matrices as (rows, cols, row-major floats)
+    void ModelWeights::save(const std::string &path) const
+    {
+        std::ofstream out(path, std::ios::binary);
+        if (!out.is_open())
+        {
+            throw std::runtime_error("Failed to open file for writing: " + path);
+        }
+
+        out.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        write_raw(out, CHECKPOINT_VERSION);
+        visit_config(config, [&](const auto &value)
+                     { write_raw(out, value); });
+
+        write_raw(out, static_cast<uint64_t>(layers.size()));
+        for (const LayerWeights &layer : layers)
+        {
+            visit_layer(layer, [&](const Matrix &matrix)
+                        { write_matrix(out, matrix); });
+            write_raw(out, static_cast<uint64_t>(layer.random_features.size()));
+            for (const Matrix &features : layer.random_features)
+            {
+                write_matrix(out, features);
+            }
+        }
+
+        if (!out)
+        {
+            throw std::runtime_error("Failed to write checkpoint: " + path);
+        }
+    }
+
+    ModelWeights ModelWeights::load(const std::string &path)
+    {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in.is_open())
+        {
+            throw std::runtime_error("Failed to open file for reading: " + path);
+        }
+        const std::streamoff file_size = in.tellg();
+        in.seekg(0);
+
+        char magic[sizeof(CHECKPOINT_MAGIC)] = {};
+        uint32_t version = 0;
+        in.read(magic, sizeof(magic));
+        read_raw(in, version);
+        if (!in || !std::equal(magic, magic + sizeof(magic), CHECKPOINT_MAGIC) || version != CHECKPOINT_VERSION)
+        {
+            throw std::runtime_error("Not a supported checkpoint: " + path);
+        }
+
+        ModelWeights weights;
+        visit_config(weights.config, [&](auto &value)
+                     { read_config_field(in, value); });
+
+        uint64_t num_layers = 0;
+        read_raw(in, num_layers);
+        if (!in || num_layers != weights.config.num_layers)
+        {
+            throw std::runtime_error("Checkpoint layer count does not match its config: " + path);
+        }
+
+        const LayerShapes shapes = layer_shapes(weights.config);
+        std::vector<MatrixShape> expected;
+        visit_layer(shapes, [&](const MatrixShape &shape)
+                    { expected.push_back(shape); });
+
+        // Layers are appended as they are read, so a corrupt layer count fails on the
+        // first missing matrix instead of sizing the vector up front
+        for (uint64_t l = 0; l < num_layers; ++l)
+        {
+            LayerWeights &layer = weights.layers.emplace_back();
+            size_t next = 0;
+            visit_layer(layer, [&](Matrix &matrix)
+                        { read_matrix(in, matrix, expected[next++], file_size); });
+
+            uint64_t num_features = 0;
+            read_raw(in, num_features);
+            if (!in)
+            {
+                throw std::runtime_error("Truncated checkpoint: " + path);
+            }
+            if (num_features != shapes.num_random_features)
+            {
+                throw std::invalid_argument("Checkpoint has the wrong number of random feature projections");
+            }
+            layer.random_features.assign(static_cast<size_t>(num_features), Matrix(0, 0));
+            for (Matrix &features : layer.random_features)
+            {
+                read_matrix(in, features, shapes.random_features, file_size);
+            }
+        }
+
+        if (!in)
+        {
+            throw std::runtime_error("Truncated checkpoint: " + path);
+        }
+
+        return weights;
+    }
+
+    void MultiHeadAttention::set_weights(const LayerWeights &weights)
+    {
+        W_q_.set_dense(weights.W_q);
+        W_k_.set_dense(weights.W_k);
+        W_v_.set_dense(weights.W_v);
+        W_o_.set_dense(weights.W_o);
+
+        check_shape(weights.linformer_E, E_.rows(), E_.cols(), "linformer_E");
+        check_shape(weights.linformer_F, F_.rows(), F_.cols(), "linformer_F");
+        check_shape(weights.relative_bias, relative_bias_.rows(), relative_bias_.cols(), "relative_bias");
+        E_ = weights.linformer_E;
+        F_ = weights.linformer_F;
+        relative_bias_ = weights.relative_bias;
+
+        if (weights.random_features.size() != random_features_.size())
+        {
+            throw std::invalid_argument("Checkpoint has the wrong number of random feature projections");
+        }
+        for (size_t h = 0; h < random_features_.size(); ++h)
+        {
+            check_shape(weights.random_features[h], random_features_[h].rows(), random_features_[h].cols(), "random_features");
+            random_features_[h] = weights.random_features[h];
+        }
+    }
+
+    void MultiHeadAttention::export_weights(LayerWeights &weights) const
+    {
+        weights.W_q = W_q_.to_dense();
+        weights.W_k = W_k_.to_dense();
+        weights.W_v = W_v_.to_dense();
+        weights.W_o = W_o_.to_dense();
+        weights.linformer_E = E_;
+        weights.linformer_F = F_;
+        weights.relative_bias = relative_bias_;
+        weights.random_features = random_features_;
+    }
+
+    void FeedForwardNetwork::set_weights(const LayerWeights &weights)
+    {
+        W1_.set_dense(weights.W1);
+        W2_.set_dense(weights.W2);
+        check_shape(weights.b1, b1_.rows(), b1_.cols(), "b1");
+        check_shape(weights.b2, b2_.rows(), b2_.cols(), "b2");
+        b1_ = weights.b1;
+        b2_ = weights.b2;
+    }
+
+    void FeedForwardNetwork::export_weights(LayerWeights &weights) const
+    {
+        weights.W1 = W1_.to_dense();
+        weights.W2 = W2_.to_dense();
+        weights.b1 = b1_;
+        weights.b2 = b2_;
+    }
+
+    void LayerNorm::set_parameters(const Matrix &gamma, const Matrix &beta)
+    {
+        check_shape(gamma, gamma_.rows(), gamma_.cols(), "norm gamma");
+        check_shape(beta, beta_.rows(), beta_.cols(), "norm beta");
+        gamma_ = gamma;
+        beta_ = beta;
+    }
+
+    void TransformerEncoderLayer::set_weights(const LayerWeights &weights)
+    {
+        if (moe_)
+        {
+            throw std::invalid_argument("ModelWeights does not cover mixture-of-experts layers");
+        }
+
+        attention_->set_weights(weights);
+        ffn_->set_weights(weights);
+        norm1_->set_parameters(weights.norm1_gamma, weights.norm1_beta);
+        norm2_->set_parameters(weights.norm2_gamma, weights.norm2_beta);
+    }
+
+    LayerWeights TransformerEncoderLayer::export_weights() const
+    {
+        if (moe_)
+        {
+            throw std::invalid_argument("ModelWeights does not cover mixture-of-experts layers");
+        }
+
+        LayerWeights weights;
+        attention_->export_weights(weights);
+        ffn_->export_weights(weights);
+        weights.norm1_gamma = norm1_->gamma();
+        weights.norm1_beta = norm1_->beta();
+        weights.norm2_gamma = norm2_->gamma();
+        weights.norm2_beta = norm2_->beta();
+        return weights;
+    }
+
+    TransformerEncoder::TransformerEncoder(const ModelWeights &weights)
+        : TransformerEncoder(checkpoint_config(weights), false)
+    {
+        if (weights.layers.size() != layers_.size())
+        {
+            throw std::invalid_argument("Checkpoint layer count does not match its config");
+        }
+
+        for (size_t l = 0; l < layers_.size(); ++l)
+        {
+            layers_[l]->set_weights(weights.layers[l]);
+        }
+    }
+
+    ModelWeights TransformerEncoder::export_weights() const
+    {
+        if (embedding_)
+        {
+            throw std::invalid_argument("ModelWeights does not cover token embedding tables");
+        }
+
+        ModelWeights weights;
+        weights.config = config_;
+        weights.layers.reserve(layers_.size());
+        for (const auto &layer : layers_)
+        {
+            weights.layers.push_back(layer->export_weights());
+        }
+        return weights;
+    }
+
+} // namespace MicroTransformer